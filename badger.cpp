@@ -1,30 +1,417 @@
+#include <algorithm>
+#include <string.h>
+
+#include "pico/stdlib.h"
+
 #include "common/pimoroni_common.hpp"
 #include "badger2040.hpp"
 
 #include "badger.h"
+#include "display_log.h"
+#include "fb_blit.h"
+#include "fb_diff.h"
+#include "fb_fill.h"
+#include "glyph_cache.h"
+#include "hash.h"
+#include "text_metrics.h"
 
 using namespace pimoroni;
 
-Badger2040 badger;
+// Badger2040 doesn't give access to the framebuffer
+class UsedBadger : public Badger2040 {
+public:
+	uint8_t *framebuffer()
+	{
+		return uc8151.frame_buffer;
+	}
+
+	const hershey::font_t *hershey_font()
+	{
+		return _font;
+	}
+
+	uint8_t current_pen()
+	{
+		return _pen;
+	}
+
+	uint8_t current_thickness()
+	{
+		return _thickness;
+	}
+
+	// Badger2040::power_off() cuts the 3V3 rail, this just stops the
+	// panel's charge pumps like the end of a blocking update does
+	void panel_power_off()
+	{
+		uc8151.power_off();
+	}
+};
+
+UsedBadger badger;
+
+// Drawing goes into the Badger2040's framebuffer, which is the back buffer.
+// The front buffer is what was last presented, i.e. what's on the panel or
+// being refreshed onto it, so that updates can skip what hasn't changed.
+// The UC8151 driver has sent the data by the time update() returns, so the
+// next frame can be drawn while the panel is still refreshing.
+static uint8_t front[FB_SIZE];
+static bool front_valid;
+// A refresh was started and hasn't finished
+static bool refreshing;
+// What was on the panel before power-on, if known
+static struct fb_fingerprint fingerprint;
+static bool fingerprint_valid;
+
+// The panel can't take any commands while it's refreshing, so updates
+// presented in the meantime wait here, oldest first. They send whatever is
+// in the back buffer when they start.
+struct display_update {
+	// Otherwise just 'region'
+	bool full;
+	uint8_t speed;
+	struct fb_region region;
+};
+#define DISPLAY_QUEUE_LEN 4
+static struct display_update display_queue[DISPLAY_QUEUE_LEN];
+static int display_queued;
+// What the panel is set up for, -1 if unknown
+static int panel_speed = -1;
+// The refresh in progress, for the display log
+static struct display_log_entry refresh_log;
+static uint32_t refresh_start_us;
+
+/*
+ * The faster waveforms leave some ghosting behind, more the more of the
+ * screen they change, and it builds up until a clean refresh with the
+ * slowest one. Each update costs its changed area (as a percentage of the
+ * screen) times a weight for its speed, and when the budget runs out the
+ * next update is a clean full refresh instead.
+ */
+#define SPEED_CLEAN  0
+#define SPEED_MEDIUM 2
+#define SPEED_FAST   3
+// Bigger changes than this use the medium waveform, which ghosts less
+#define SPEED_FAST_MAX_PERCENT 25
+static const uint8_t ghost_weight[4] = { 0, 1, 2, 3 };
+#define GHOST_BUDGET 500
+// Nothing is known about the panel at power-on, so start with a clean refresh
+static int ghost = GHOST_BUDGET + 1;
+
+// Marked with badger_dirty(), for the next badger_present_dirty()
+static struct fb_dirty dirty;
+
+// Each partial update is a separate refresh, so don't do too many
+#define DIFF_MAX_REGIONS 3
+// If more than this much of the screen changed, do a full update instead
+#define DIFF_FULL_UPDATE_PERCENT 60
+
+// Identifies the current font in glyph cache keys
+static uint32_t font_id;
 
 void badger_init(void)
 {
 	badger.init();
 }
 
-void badger_update(bool blocking)
+// Start the next queued update, if the panel is idle
+static void badger_display_kick(void)
+{
+	if (refreshing || (display_queued == 0)) {
+		return;
+	}
+
+	struct display_update u = display_queue[0];
+	display_queued--;
+	memmove(&display_queue[0], &display_queue[1], display_queued * sizeof(u));
+
+	// Changing the speed resets the panel, so only do it when needed
+	if (u.speed != panel_speed) {
+		badger.update_speed(u.speed);
+		panel_speed = u.speed;
+	}
+
+	refresh_log = (struct display_log_entry){
+		.start_ms = to_ms_since_boot(get_absolute_time()),
+		.full = u.full,
+		.speed = u.speed,
+	};
+	if (!u.full) {
+		refresh_log.x = u.region.x;
+		refresh_log.y = u.region.y;
+		refresh_log.w = u.region.w;
+		refresh_log.h = u.region.h;
+	}
+	refresh_start_us = time_us_32();
+
+	if (u.full) {
+		badger.update(false);
+		memcpy(front, badger.framebuffer(), sizeof(front));
+		front_valid = true;
+	} else {
+		badger.partial_update(u.region.x, u.region.y, u.region.w, u.region.h, false);
+		fb_copy_region(front, badger.framebuffer(), &u.region);
+	}
+
+	refreshing = true;
+}
+
+static void badger_display_queue(bool full, const struct fb_region *region, uint8_t speed)
+{
+	struct display_update u = { .full = full, .speed = speed };
+
+	if (!full) {
+		u.region = *region;
+	}
+
+	for (int i = 0; i < display_queued; ) {
+		struct display_update *q = &display_queue[i];
+
+		// Will already be sent, but at the slower speed of the two, so
+		// that e.g. a clean refresh isn't lost
+		if (q->full) {
+			if (u.speed < q->speed) {
+				q->speed = u.speed;
+			}
+			badger_display_done();
+			return;
+		}
+
+		// Send overlapping or touching regions as one update, at the
+		// slower speed of the two. The bigger region can touch others
+		// which were already checked, so start again.
+		if (!full && fb_region_touches(&q->region, &u.region)) {
+			fb_region_union(&u.region, &q->region);
+			if (q->speed < u.speed) {
+				u.speed = q->speed;
+			}
+
+			display_queued--;
+			memmove(q, q + 1, (display_queued - i) * sizeof(*q));
+			i = 0;
+			continue;
+		}
+
+		i++;
+	}
+
+	// A full update sends everything that was waiting, and if there's no
+	// room then everything waiting is turned into one
+	if (full || (display_queued == DISPLAY_QUEUE_LEN)) {
+		for (int i = 0; i < display_queued; i++) {
+			if (display_queue[i].speed < u.speed) {
+				u.speed = display_queue[i].speed;
+			}
+		}
+		u.full = true;
+		display_queued = 0;
+	}
+
+	display_queue[display_queued++] = u;
+
+	// Also catches up if a DISPLAY_DONE message got lost
+	badger_display_done();
+}
+
+void badger_display_done(void)
+{
+	if (refreshing) {
+		// Stale, or the BUSY edge from something other than a refresh
+		if (badger.is_busy()) {
+			return;
+		}
+
+		// Includes however long the DISPLAY_DONE message waited, which is
+		// usually much less than a millisecond
+		refresh_log.busy_ms = (time_us_32() - refresh_start_us) / 1000;
+		display_log_record(&refresh_log);
+
+		// Same as the end of a blocking update
+		badger.panel_power_off();
+		refreshing = false;
+	}
+
+	badger_display_kick();
+}
+
+// Wait until everything queued has been started
+static void badger_display_flush(void)
+{
+	while (display_queued) {
+		while (badger.is_busy()) {
+			tight_loop_contents();
+		}
+		badger_display_done();
+	}
+}
+
+void badger_fence(void)
+{
+	badger_display_flush();
+
+	while (refreshing) {
+		while (badger.is_busy()) {
+			tight_loop_contents();
+		}
+		badger_display_done();
+	}
+}
+
+// Pick the speed for an update changing 'area' pixels, and charge it to the
+// ghosting budget. Returns false if it has to be a clean refresh instead.
+static bool badger_schedule(int area, uint8_t *speed)
+{
+	int screen = BADGER_WIDTH * BADGER_HEIGHT;
+	int percent = (area * 100 + screen - 1) / screen;
+	uint8_t s = percent > SPEED_FAST_MAX_PERCENT ? SPEED_MEDIUM : SPEED_FAST;
+	int cost = percent * ghost_weight[s];
+
+	if (ghost + cost > GHOST_BUDGET) {
+		return false;
+	}
+
+	ghost += cost;
+	*speed = s;
+
+	return true;
+}
+
+static void badger_present_clean(void)
+{
+	badger_display_queue(true, NULL, SPEED_CLEAN);
+	ghost = 0;
+}
+
+void badger_refresh_clean(void)
 {
-	badger.update(blocking);
+	// Nothing to clean up if only clean refreshes happened since the last
+	if (ghost > 0) {
+		ghost = GHOST_BUDGET + 1;
+	}
 }
 
-void badger_partial_update(int x, int y, int w, int h, bool blocking)
+void badger_present(void)
 {
-	badger.partial_update(x, y, w, h, blocking);
+	uint8_t speed;
+
+	fb_dirty_clear(&dirty);
+
+	if (!badger_schedule(BADGER_WIDTH * BADGER_HEIGHT, &speed)) {
+		badger_present_clean();
+		return;
+	}
+
+	badger_display_queue(true, NULL, speed);
 }
 
-void badger_update_speed(uint8_t speed)
+void badger_dirty(int x, int y, int w, int h)
 {
-	badger.update_speed(speed);
+	fb_dirty_add(&dirty, x, y, w, h);
+}
+
+void badger_present_dirty(void)
+{
+	for (int i = 0; i < dirty.n; i++) {
+		struct fb_region *region = &dirty.regions[i];
+		uint8_t speed;
+
+		// The clean refresh covers all of the regions
+		if (!badger_schedule(region->w * region->h, &speed)) {
+			badger_present_clean();
+			break;
+		}
+
+		badger_display_queue(false, region, speed);
+	}
+
+	fb_dirty_clear(&dirty);
+}
+
+void badger_present_region(int x, int y, int w, int h)
+{
+	badger_dirty(x, y, w, h);
+	badger_present_dirty();
+}
+
+void badger_present_changed(void)
+{
+	struct fb_region regions[DIFF_MAX_REGIONS];
+	uint8_t *fb = badger.framebuffer();
+	int area = 0;
+
+	int n;
+	if (front_valid) {
+		n = fb_diff(fb, front, regions, DIFF_MAX_REGIONS);
+	} else if (fingerprint_valid) {
+		n = fb_diff_fingerprint(fb, &fingerprint, regions, DIFF_MAX_REGIONS);
+	} else {
+		badger_present();
+		return;
+	}
+
+	// Everything outside 'regions' is already on the panel, and the
+	// regions are copied again as they're sent
+	memcpy(front, fb, sizeof(front));
+	front_valid = true;
+	// Anything marked dirty which really changed is in 'regions'
+	fb_dirty_clear(&dirty);
+
+	// Even if nothing changed, when asked for
+	if (ghost > GHOST_BUDGET) {
+		badger_present_clean();
+		return;
+	}
+
+	if (n == 0) {
+		return;
+	}
+
+	for (int i = 0; i < n; i++) {
+		area += regions[i].w * regions[i].h;
+	}
+
+	if (area * 100 > BADGER_WIDTH * BADGER_HEIGHT * DIFF_FULL_UPDATE_PERCENT) {
+		badger_present();
+		return;
+	}
+
+	for (int i = 0; i < n; i++) {
+		uint8_t speed;
+
+		// The clean refresh covers all of the regions
+		if (!badger_schedule(regions[i].w * regions[i].h, &speed)) {
+			badger_present_clean();
+			return;
+		}
+
+		badger_display_queue(false, &regions[i], speed);
+	}
+}
+
+bool badger_get_fingerprint(struct fb_fingerprint *fp)
+{
+	// The front buffer isn't what will be on the panel until everything
+	// queued has been sent
+	badger_display_flush();
+
+	if (front_valid) {
+		fb_fingerprint(front, fp);
+		return true;
+	} else if (fingerprint_valid) {
+		*fp = fingerprint;
+		return true;
+	}
+
+	return false;
+}
+
+void badger_set_fingerprint(const struct fb_fingerprint *fp)
+{
+	fingerprint = *fp;
+	fingerprint_valid = true;
+
+	// The panel was left clean at power-off
+	ghost = 0;
 }
 
 uint32_t badger_update_time()
@@ -34,11 +421,13 @@ uint32_t badger_update_time()
 
 void badger_halt()
 {
+	badger_fence();
 	badger.halt();
 }
 
 void badger_sleep()
 {
+	badger_fence();
 	badger.sleep();
 }
 
@@ -49,11 +438,13 @@ bool badger_is_busy()
 
 void badger_power_off()
 {
+	badger_fence();
 	badger.power_off();
 }
 
 void badger_invert(bool invert)
 {
+	badger_fence();
 	badger.invert(invert);
 }
 
@@ -65,6 +456,9 @@ void badger_led(uint8_t brightness)
 
 void badger_font(const char *name)
 {
+	if (hershey::has_font(name)) {
+		font_id = fnv1a_update(FNV1A_INIT, name, strlen(name));
+	}
 	badger.font(std::string(name));
 }
 
@@ -107,7 +501,7 @@ uint32_t badger_button_states()
 // drawing primitives
 void badger_clear()
 {
-	badger.clear();
+	fb_fill(badger.framebuffer(), badger.current_pen());
 }
 
 void badger_pixel(int32_t x, int32_t y)
@@ -120,47 +514,144 @@ void badger_line(int32_t x1, int32_t y1, int32_t x2, int32_t y2)
 	badger.line(x1, y1, x2, y2);
 }
 
+// Badger2040::rectangle() plots every pixel separately
 void badger_rectangle(int32_t x, int32_t y, int32_t w, int32_t h)
 {
-	badger.rectangle(x, y, w, h);
+	fb_fill_rect(badger.framebuffer(), x, y, w, h, badger.current_pen());
 }
 
 void badger_icon(const uint8_t *data, int sheet_width, int icon_size, int index, int dx, int dy)
 {
-	badger.icon(data, sheet_width, icon_size, index, dx, dy);
+	badger_subimage(data, sheet_width, index * icon_size, 0, icon_size, icon_size, dx, dy);
 }
 
 void badger_image_fullscreen(const uint8_t *data)
 {
-	badger.image(data);
+	badger_subimage(data, BADGER_WIDTH, 0, 0, BADGER_WIDTH, BADGER_HEIGHT, 0, 0);
 }
 
 void badger_image(const uint8_t *data, int w, int h, int x, int y)
 {
-	badger.image(data, w, h, x, y);
+	badger_subimage(data, w, 0, 0, w, h, x, y);
 }
 
 void badger_subimage(const uint8_t *data, int stride, int sx, int sy, int dw, int dh, int dx, int dy)
 {
-	badger.image(data, stride, sx, sy, dw, dh, dx, dy);
+	// Badger2040::image() plots each pixel through pixel(), which draws a
+	// square for anything thicker
+	if (badger.current_thickness() != 1) {
+		badger.image(data, stride, sx, sy, dw, dh, dx, dy);
+		return;
+	}
+
+	fb_blit_image(badger.framebuffer(), data, stride, sx, sy, dw, dh, dx, dy);
+}
+
+// Find 'c' in the glyph cache, stroking it into the cache if it's not there
+static const struct glyph *badger_cached_glyph(unsigned char c, int32_t s)
+{
+	uint8_t thickness = badger.current_thickness();
+	struct glyph_key key = glyph_key(font_id, s, thickness, c);
+	const struct glyph *cached = glyph_cache_find(&key);
+	if (cached) {
+		return cached;
+	}
+
+	int32_t min_x = INT32_MAX, min_y = INT32_MAX, max_x = INT32_MIN, max_y = INT32_MIN;
+	int32_t advance = hershey::glyph(badger.hershey_font(), [&](int32_t x1, int32_t y1, int32_t x2, int32_t y2) {
+		min_x = std::min(min_x, std::min(x1, x2));
+		min_y = std::min(min_y, std::min(y1, y2));
+		max_x = std::max(max_x, std::max(x1, x2));
+		max_y = std::max(max_y, std::max(y1, y2));
+	}, c, GLYPH_ORIGIN, GLYPH_ORIGIN, badger_fixed_to_float(s), 0.0f);
+
+	int32_t ht = thickness / 2;
+	struct glyph *g;
+	if (max_x < min_x) {
+		// Nothing to draw, e.g. a space
+		g = glyph_cache_add(&key, 0, 0, 0, 0, advance);
+	} else {
+		g = glyph_cache_add(&key, min_x - ht - GLYPH_ORIGIN, min_y - ht - GLYPH_ORIGIN,
+				max_x - min_x + thickness, max_y - min_y + thickness, advance);
+	}
+	if (!g) {
+		return NULL;
+	}
+
+	hershey::glyph(badger.hershey_font(), [&](int32_t x1, int32_t y1, int32_t x2, int32_t y2) {
+		glyph_mask_line(g, x1 - min_x + ht, y1 - min_y + ht, x2 - min_x + ht, y2 - min_y + ht, thickness);
+	}, c, GLYPH_ORIGIN, GLYPH_ORIGIN, badger_fixed_to_float(s), 0.0f);
+
+	return g;
+}
+
+void badger_text(const char *message, int32_t x, int32_t y, int32_t s, int32_t a, uint8_t letter_spacing)
+{
+	// Only unrotated text is cached
+	if (a != 0) {
+		badger.text(std::string(message), x, y, badger_fixed_to_float(s), badger_fixed_to_float(a), letter_spacing);
+		return;
+	}
+
+	uint8_t *fb = badger.framebuffer();
+	uint8_t pen = badger.current_pen();
+	for (const char *c = message; *c; c++) {
+		const struct glyph *g = badger_cached_glyph(*c, s);
+		if (g) {
+			glyph_blit(fb, g, x, y, pen);
+			x += g->advance + letter_spacing;
+		} else {
+			x += badger.glyph(*c, x, y, badger_fixed_to_float(s), 0.0f) + letter_spacing;
+		}
+	}
+}
+
+void badger_cache_text(const char *message, int32_t s)
+{
+	for (const char *c = message; *c; c++) {
+		badger_cached_glyph(*c, s);
+	}
+}
+
+void badger_image_cols(const uint8_t *data, int w, int h, int x, int y, int x0, int x1)
+{
+	fb_blit_image_cols(badger.framebuffer(), data, w, 0, 0, w, h, x, y, x0, x1);
+}
+
+bool badger_text_cols(const char *message, int32_t x, int32_t y, int32_t s, uint8_t pen,
+		uint8_t thickness, uint8_t letter_spacing, int x0, int x1)
+{
+	uint8_t *fb = badger.framebuffer();
+	for (const char *c = message; *c; c++) {
+		struct glyph_key key = glyph_key(font_id, s, thickness, *c);
+		const struct glyph *g = glyph_cache_find(&key);
+		if (!g) {
+			return false;
+		}
+
+		glyph_blit_cols(fb, g, x, y, pen, x0, x1);
+		x += g->advance + letter_spacing;
+	}
+
+	return true;
 }
 
-void badger_text(const char *message, int32_t x, int32_t y, float s, float a, uint8_t letter_spacing)
+int32_t badger_glyph(unsigned char c, int32_t x, int32_t y, int32_t s, int32_t a)
 {
-	badger.text(std::string(message), x, y, s, a, letter_spacing);
+	return badger.glyph(c, x, y, badger_fixed_to_float(s), badger_fixed_to_float(a));
 }
 
-int32_t badger_glyph(unsigned char c, int32_t x, int32_t y, float s, float a)
+const struct text_metrics *badger_text_metrics(int32_t s)
 {
-	return badger.glyph(c, x, y, s, a);
+	return text_metrics_get(badger.hershey_font(), font_id, s);
 }
 
-int32_t badger_measure_text(const char *message, float s, uint8_t letter_spacing)
+int32_t badger_measure_text(const char *message, int32_t s, uint8_t letter_spacing)
 {
-	return badger.measure_text(std::string(message), s, letter_spacing);
+	return text_metrics_measure(badger_text_metrics(s), message, letter_spacing);
 }
 
-int32_t badger_measure_glyph(unsigned char c, float s)
+int32_t badger_measure_glyph(unsigned char c, int32_t s)
 {
-	return badger.measure_glyph(c, s);
+	return badger.measure_glyph(c, badger_fixed_to_float(s));
 }
@@ -10,8 +10,20 @@
 
 #define BADGER_WIDTH 296
 #define BADGER_HEIGHT 128
-// TODO: Is this right?
-#define HERSHEY_HEIGHT 36
+
+// Text sizes and angles (in degrees) are 16.16 fixed point, so that drawing
+// text doesn't need soft-float. Only stroking glyphs which aren't in the glyph
+// cache goes through float, inside the Hershey library.
+#define BADGER_FIXED_SHIFT 16
+#define BADGER_FIXED_ONE   (1 << BADGER_FIXED_SHIFT)
+// For constants, e.g. BADGER_FIXED(0.4f), which the compiler folds
+#define BADGER_FIXED(_x)   ((int32_t)((_x) * BADGER_FIXED_ONE))
+
+// Only for passing to the Hershey library
+static inline float badger_fixed_to_float(int32_t v)
+{
+	return (float)v / BADGER_FIXED_ONE;
+}
 
 enum badger_pin {
 	BADGER_PIN_A           = 12,
@@ -36,9 +48,40 @@ enum badger_pin {
 
 void badger_init(void);
 
-void badger_update(bool blocking);
-void badger_partial_update(int x, int y, int w, int h, bool blocking);
-void badger_update_speed(uint8_t speed);
+// Drawing is double-buffered: presenting sends what's been drawn to the
+// panel and starts a refresh, but doesn't wait for it. Drawing the next frame
+// can start straight away.
+// If the panel is still refreshing, the update is queued instead, and sends
+// whatever has been drawn by the time it starts.
+void badger_present(void);
+// Mark a rectangle to present with badger_present_dirty(). Rectangles are
+// widened to the panel's 8-row bands, and ones which overlap or touch are
+// merged, so that they go out in as few partial updates as possible.
+void badger_dirty(int x, int y, int w, int h);
+void badger_present_dirty(void);
+// Marks the rectangle dirty, and presents everything that is
+void badger_present_region(int x, int y, int w, int h);
+// Only present the parts of the display which changed since the last
+// present, or all of it if most of it changed
+void badger_present_changed(void);
+// Call when BADGER_PIN_BUSY goes high, to start the next queued update.
+// Harmless if the refresh hasn't actually finished.
+void badger_display_done(void);
+// Wait for everything presented to finish refreshing the panel. Needed
+// before cutting the power.
+void badger_fence(void);
+
+// Get a fingerprint of what's on the panel, returns false if it's not known
+struct fb_fingerprint;
+bool badger_get_fingerprint(struct fb_fingerprint *fp);
+// Say what was on the panel from before power-on, so that
+// badger_present_changed() doesn't have to refresh it all
+void badger_set_fingerprint(const struct fb_fingerprint *fp);
+// The update speed is picked for each update from how much of the screen
+// changed and how much ghosting has built up. This makes the next update a
+// clean (slow) full refresh anyway, e.g. before the image has to last, unless
+// nothing but clean refreshes have happened since the last one.
+void badger_refresh_clean(void);
 uint32_t badger_update_time();
 void badger_halt();
 void badger_sleep();
@@ -63,6 +106,7 @@ uint32_t badger_button_states();
 void badger_clear();
 void badger_pixel(int32_t x, int32_t y);
 void badger_line(int32_t x1, int32_t y1, int32_t x2, int32_t y2);
+// Filled with the pen, whatever the thickness
 void badger_rectangle(int32_t x, int32_t y, int32_t w, int32_t h);
 
 void badger_icon(const uint8_t *data, int sheet_width, int icon_size, int index, int dx, int dy);
@@ -70,11 +114,27 @@ void badger_image_fullscreen(const uint8_t *data);
 void badger_image(const uint8_t *data, int w, int h, int x, int y);
 void badger_subimage(const uint8_t *data, int stride, int sx, int sy, int dw, int dh, int dx, int dy);
 
-void badger_text(const char *message, int32_t x, int32_t y, float s, float a, uint8_t letter_spacing);
-int32_t badger_glyph(unsigned char c, int32_t x, int32_t y, float s, float a);
+void badger_text(const char *message, int32_t x, int32_t y, int32_t s, int32_t a, uint8_t letter_spacing);
+int32_t badger_glyph(unsigned char c, int32_t x, int32_t y, int32_t s, int32_t a);
+// Put the glyphs for 'message' in the glyph cache, with the current font and
+// thickness, without drawing anything
+void badger_cache_text(const char *message, int32_t s);
+
+// Draw into framebuffer columns 'x0' to 'x1' - 1 only, without using or
+// changing the drawing state (pen, thickness), so that both cores can draw
+// different columns at the same time.
+// Images are drawn as with a thickness of 1.
+void badger_image_cols(const uint8_t *data, int w, int h, int x, int y, int x0, int x1);
+// Only draws from the glyph cache, in the current font. Returns false if
+// any glyph wasn't cached, in which case the text is incomplete.
+bool badger_text_cols(const char *message, int32_t x, int32_t y, int32_t s, uint8_t pen,
+		uint8_t thickness, uint8_t letter_spacing, int x0, int x1);
 
-int32_t badger_measure_text(const char *message, float s, uint8_t letter_spacing);
-int32_t badger_measure_glyph(unsigned char c, float s);
+// Metrics for the current font at size 's'
+struct text_metrics;
+const struct text_metrics *badger_text_metrics(int32_t s);
+int32_t badger_measure_text(const char *message, int32_t s, uint8_t letter_spacing);
+int32_t badger_measure_glyph(unsigned char c, int32_t s);
 
 #ifdef __cplusplus
  }
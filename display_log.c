@@ -0,0 +1,135 @@
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "display_log.h"
+#include "page_file.h"
+
+#define DISPLAY_LOG_PATH PAGE_SYS_DIR "/display.log"
+// Longest line written to the log
+#define DISPLAY_LOG_LINE_MAX 64
+
+// 'count' entries, oldest first, ending just before 'head'
+static struct display_log_entry ring[DISPLAY_LOG_LEN];
+static unsigned int head, count;
+// Overwritten before they were flushed
+static unsigned int dropped;
+// The first flush after boot marks the start of a wake in the log
+static bool flushed;
+
+void display_log_record(const struct display_log_entry *entry)
+{
+	ring[head] = *entry;
+	head = (head + 1) % DISPLAY_LOG_LEN;
+
+	if (count < DISPLAY_LOG_LEN) {
+		count++;
+	} else {
+		dropped++;
+	}
+}
+
+static const struct display_log_entry *display_log_get(unsigned int i)
+{
+	return &ring[(head + DISPLAY_LOG_LEN - count + i) % DISPLAY_LOG_LEN];
+}
+
+static int display_log_format(const struct display_log_entry *e, char *buf, size_t len)
+{
+	return snprintf(buf, len, "%lu,%u,%s,%u,%u,%u,%u,%u\n",
+			(unsigned long)e->start_ms, e->busy_ms, e->full ? "full" : "partial",
+			e->speed, e->x, e->y, e->w, e->h);
+}
+
+int display_log_flush(lfs_t *lfs)
+{
+	struct lfs_info info;
+	lfs_file_t fp;
+	char line[DISPLAY_LOG_LINE_MAX];
+	int flags = LFS_O_CREAT | LFS_O_APPEND | LFS_O_WRONLY;
+	int res, len;
+
+	if (!count) {
+		return 0;
+	}
+
+	// Nothing may have been synced yet
+	res = lfs_mkdir(lfs, PAGE_SYS_DIR);
+	if (res && res != LFS_ERR_EXIST) {
+		return res;
+	}
+
+	// Start again rather than go over the limit
+	bool restart = false;
+	res = lfs_stat(lfs, DISPLAY_LOG_PATH, &info);
+	if (!res && (info.size + (count + 2) * DISPLAY_LOG_LINE_MAX > DISPLAY_LOG_MAX_SIZE)) {
+		flags = LFS_O_CREAT | LFS_O_TRUNC | LFS_O_WRONLY;
+		restart = true;
+	}
+
+	res = lfs_file_open(lfs, &fp, DISPLAY_LOG_PATH, flags);
+	if (res) {
+		return res;
+	}
+
+	if (!flushed || restart) {
+		len = snprintf(line, sizeof(line), "# start_ms,busy_ms,mode,speed,x,y,w,h\n");
+		res = lfs_file_write(lfs, &fp, line, len);
+		if (res != len) {
+			goto err_close;
+		}
+	}
+
+	if (dropped) {
+		len = snprintf(line, sizeof(line), "# %u dropped\n", dropped);
+		res = lfs_file_write(lfs, &fp, line, len);
+		if (res != len) {
+			goto err_close;
+		}
+	}
+
+	for (unsigned int i = 0; i < count; i++) {
+		len = display_log_format(display_log_get(i), line, sizeof(line));
+		res = lfs_file_write(lfs, &fp, line, len);
+		if (res != len) {
+			goto err_close;
+		}
+	}
+
+	res = lfs_file_close(lfs, &fp);
+	printf("flushed %u display timings: %d\n", count, res);
+	if (!res) {
+		count = 0;
+		dropped = 0;
+		flushed = true;
+	}
+
+	return res;
+
+err_close:
+	lfs_file_close(lfs, &fp);
+	return res < 0 ? res : LFS_ERR_IO;
+}
+
+void display_log_dump(lfs_t *lfs)
+{
+	char line[DISPLAY_LOG_LINE_MAX];
+	lfs_file_t fp;
+	int res;
+
+	printf("--- %s\n", DISPLAY_LOG_PATH);
+
+	res = lfs_file_open(lfs, &fp, DISPLAY_LOG_PATH, LFS_O_RDONLY);
+	if (!res) {
+		while ((res = lfs_file_read(lfs, &fp, line, sizeof(line))) > 0) {
+			printf("%.*s", res, line);
+		}
+		lfs_file_close(lfs, &fp);
+	}
+
+	printf("--- not flushed (%u dropped)\n", dropped);
+
+	for (unsigned int i = 0; i < count; i++) {
+		display_log_format(display_log_get(i), line, sizeof(line));
+		printf("%s", line);
+	}
+}
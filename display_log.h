@@ -0,0 +1,48 @@
+#ifndef __DISPLAY_LOG_H__
+#define __DISPLAY_LOG_H__
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "littlefs/lfs.h"
+
+/*
+ * Timings of real panel refreshes, to see where the time (and battery) goes
+ * when the badge wakes up. The display layer records each update into a RAM
+ * ring buffer as it finishes, and it's appended to a text log in littlefs
+ * before the power goes off.
+ */
+#define DISPLAY_LOG_LEN 32
+// Two littlefs blocks. The log starts again from empty rather than grow past
+// this, as the pages need the space more.
+#define DISPLAY_LOG_MAX_SIZE (8 * 1024)
+
+struct display_log_entry {
+	// Since boot
+	uint32_t start_ms;
+	// From sending the update until BUSY was seen to go high again
+	uint16_t busy_ms;
+	uint8_t full;
+	uint8_t speed;
+	// Only for partial updates
+	uint16_t x, w;
+	uint8_t y, h;
+};
+
+void display_log_record(const struct display_log_entry *entry);
+
+// Append everything recorded since the last flush to the log. Returns 0, or
+// a negative littlefs error.
+int display_log_flush(lfs_t *lfs);
+
+// Print the log, and anything recorded which isn't in it yet, to stdout
+void display_log_dump(lfs_t *lfs);
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif /* __DISPLAY_LOG_H__ */
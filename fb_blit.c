@@ -0,0 +1,106 @@
+#include "fb_blit.h"
+#include "fb_diff.h"
+
+// Transpose an 8x8 block of bits: bit 7 of cols[c] is bit (7 - c) of rows[0].
+// From Hacker's Delight, section 7-3.
+static void transpose8(const uint8_t rows[8], uint8_t cols[8])
+{
+	uint32_t x = ((uint32_t)rows[0] << 24) | (rows[1] << 16) | (rows[2] << 8) | rows[3];
+	uint32_t y = ((uint32_t)rows[4] << 24) | (rows[5] << 16) | (rows[6] << 8) | rows[7];
+	uint32_t t;
+
+	t = (x ^ (x >> 7)) & 0x00aa00aa;
+	x = x ^ t ^ (t << 7);
+	t = (y ^ (y >> 7)) & 0x00aa00aa;
+	y = y ^ t ^ (t << 7);
+
+	t = (x ^ (x >> 14)) & 0x0000cccc;
+	x = x ^ t ^ (t << 14);
+	t = (y ^ (y >> 14)) & 0x0000cccc;
+	y = y ^ t ^ (t << 14);
+
+	t = (x & 0xf0f0f0f0) | ((y >> 4) & 0x0f0f0f0f);
+	y = ((x << 4) & 0xf0f0f0f0) | (y & 0x0f0f0f0f);
+	x = t;
+
+	cols[0] = x >> 24;
+	cols[1] = x >> 16;
+	cols[2] = x >> 8;
+	cols[3] = x;
+	cols[4] = y >> 24;
+	cols[5] = y >> 16;
+	cols[6] = y >> 8;
+	cols[7] = y;
+}
+
+void fb_blit_image(uint8_t *fb, const uint8_t *data, int stride, int sx, int sy,
+		int dw, int dh, int dx, int dy)
+{
+	fb_blit_image_cols(fb, data, stride, sx, sy, dw, dh, dx, dy, 0, BADGER_WIDTH);
+}
+
+void fb_blit_image_cols(uint8_t *fb, const uint8_t *data, int stride, int sx, int sy,
+		int dw, int dh, int dx, int dy, int x0, int x1)
+{
+	int row_bytes = stride / 8;
+
+	if (dx < x0) {
+		sx += x0 - dx;
+		dw -= x0 - dx;
+		dx = x0;
+	}
+	if (dy < 0) {
+		sy -= dy;
+		dh += dy;
+		dy = 0;
+	}
+	if (dx + dw > x1) {
+		dw = x1 - dx;
+	}
+	if (dy + dh > BADGER_HEIGHT) {
+		dh = BADGER_HEIGHT - dy;
+	}
+	if ((dw <= 0) || (dh <= 0)) {
+		return;
+	}
+
+	// One band of the framebuffer at a time, which may only be partly
+	// covered at the top and bottom of the image
+	for (int y = dy; y < dy + dh; ) {
+		int band = y / 8;
+		int r0 = y & 0x7;
+		int n = dy + dh - y < 8 - r0 ? dy + dh - y : 8 - r0;
+		uint8_t band_mask = (0xff >> r0) & (0xff << (8 - r0 - n));
+		const uint8_t *src = &data[(sy + y - dy) * row_bytes];
+
+		for (int x = dx; x < dx + dw; x += 8) {
+			int n_cols = dx + dw - x < 8 ? dx + dw - x : 8;
+			int ix = sx + x - dx;
+			int o = ix / 8, shift = ix & 0x7;
+			uint8_t rows[8] = { 0 };
+			uint8_t cols[8];
+
+			for (int r = 0; r < n; r++) {
+				const uint8_t *p = &src[r * row_bytes + o];
+				uint8_t b = p[0] << shift;
+
+				// Only read the next byte if any of its pixels are used
+				if (shift && (n_cols > 8 - shift)) {
+					b |= p[1] >> (8 - shift);
+				}
+				rows[r0 + r] = b;
+			}
+
+			transpose8(rows, cols);
+
+			for (int c = 0; c < n_cols; c++) {
+				uint8_t *p = &fb[(x + c) * FB_BANDS + band];
+
+				// Set bits in the image are white, which is 0 in the framebuffer
+				*p = (*p & ~band_mask) | (~cols[c] & band_mask);
+			}
+		}
+
+		y += n;
+	}
+}
@@ -0,0 +1,31 @@
+#ifndef __FB_BLIT_H__
+#define __FB_BLIT_H__
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#include <stdint.h>
+
+/*
+ * Images are row-major, 8 pixels per byte with the MSB on the left, and a set
+ * bit is white. Rows are stride / 8 bytes, like Badger2040::image(), so the
+ * stride must be a multiple of 8. The framebuffer is column-major with 8 rows per byte, so
+ * images are copied 8x8 pixels at a time, transposing each block.
+ */
+
+// Draw the 'dw' x 'dh' pixels at 'sx', 'sy' of an image 'stride' pixels wide
+// into 'fb' at 'dx', 'dy', clipped to the screen.
+// The same as Badger2040::image() with a thickness of 1.
+void fb_blit_image(uint8_t *fb, const uint8_t *data, int stride, int sx, int sy,
+		int dw, int dh, int dx, int dy);
+
+// The same, but only touching framebuffer columns 'x0' to 'x1' - 1
+void fb_blit_image_cols(uint8_t *fb, const uint8_t *data, int stride, int sx, int sy,
+		int dw, int dh, int dx, int dy, int x0, int x1);
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif /* __FB_BLIT_H__ */
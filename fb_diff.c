@@ -0,0 +1,233 @@
+#include <limits.h>
+#include <string.h>
+
+#include "fb_diff.h"
+#include "hash.h"
+
+// Turn the changed column range of each band (x_max < 0 for no change) into
+// at most 'max_regions' regions
+static int fb_bands_to_regions(const int16_t *x_min, const int16_t *x_max,
+		struct fb_region *regions, int max_regions)
+{
+	int n = 0;
+
+	// Runs of consecutive changed bands, in band units to start with
+	struct fb_region runs[FB_BANDS];
+	for (int b = 0; b < FB_BANDS; b++) {
+		if (x_max[b] < 0) {
+			continue;
+		}
+
+		if (n && (runs[n - 1].y + runs[n - 1].h == b)) {
+			struct fb_region *run = &runs[n - 1];
+			int x1 = run->x + run->w;
+
+			if (x_min[b] < run->x) {
+				run->x = x_min[b];
+			}
+			if (x_max[b] + 1 > x1) {
+				x1 = x_max[b] + 1;
+			}
+			run->w = x1 - run->x;
+			run->h++;
+		} else {
+			runs[n++] = (struct fb_region){
+				.x = x_min[b],
+				.y = b,
+				.w = x_max[b] + 1 - x_min[b],
+				.h = 1,
+			};
+		}
+	}
+
+	// Merge the runs with the smallest gaps between them until they fit
+	while (n > max_regions && n > 1) {
+		int best = 0;
+		for (int i = 1; i < n - 1; i++) {
+			int gap = runs[i + 1].y - (runs[i].y + runs[i].h);
+			int best_gap = runs[best + 1].y - (runs[best].y + runs[best].h);
+			if (gap < best_gap) {
+				best = i;
+			}
+		}
+
+		struct fb_region *a = &runs[best], *b = &runs[best + 1];
+		int x0 = a->x < b->x ? a->x : b->x;
+		int x1 = (a->x + a->w) > (b->x + b->w) ? (a->x + a->w) : (b->x + b->w);
+
+		a->h = (b->y + b->h) - a->y;
+		a->x = x0;
+		a->w = x1 - x0;
+
+		memmove(b, b + 1, (n - best - 2) * sizeof(*b));
+		n--;
+	}
+
+	for (int i = 0; i < n; i++) {
+		regions[i] = runs[i];
+		regions[i].y *= 8;
+		regions[i].h *= 8;
+	}
+
+	return n;
+}
+
+int fb_diff(const uint8_t *fb, const uint8_t *shadow, struct fb_region *regions, int max_regions)
+{
+	// Changed column range for each band
+	int16_t x_min[FB_BANDS], x_max[FB_BANDS];
+
+	for (int b = 0; b < FB_BANDS; b++) {
+		x_min[b] = BADGER_WIDTH;
+		x_max[b] = -1;
+	}
+
+	for (int x = 0; x < BADGER_WIDTH; x++) {
+		const uint8_t *col = &fb[x * FB_BANDS];
+		const uint8_t *shadow_col = &shadow[x * FB_BANDS];
+
+		if (memcmp(col, shadow_col, FB_BANDS) == 0) {
+			continue;
+		}
+
+		for (int b = 0; b < FB_BANDS; b++) {
+			if (col[b] != shadow_col[b]) {
+				if (x < x_min[b]) {
+					x_min[b] = x;
+				}
+				x_max[b] = x;
+			}
+		}
+	}
+
+	return fb_bands_to_regions(x_min, x_max, regions, max_regions);
+}
+
+void fb_fingerprint(const uint8_t *fb, struct fb_fingerprint *fp)
+{
+	for (int b = 0; b < FB_BANDS; b++) {
+		fp->bands[b] = FNV1A_INIT;
+	}
+
+	// One pass over the framebuffer, hashing each band as it goes
+	for (int x = 0; x < BADGER_WIDTH; x++) {
+		const uint8_t *col = &fb[x * FB_BANDS];
+
+		for (int b = 0; b < FB_BANDS; b++) {
+			fp->bands[b] = fnv1a_update(fp->bands[b], &col[b], 1);
+		}
+	}
+}
+
+int fb_diff_fingerprint(const uint8_t *fb, const struct fb_fingerprint *fp,
+		struct fb_region *regions, int max_regions)
+{
+	struct fb_fingerprint current;
+	int16_t x_min[FB_BANDS], x_max[FB_BANDS];
+
+	fb_fingerprint(fb, &current);
+
+	// There's no way to tell which columns changed, so it's whole bands
+	for (int b = 0; b < FB_BANDS; b++) {
+		bool changed = current.bands[b] != fp->bands[b];
+
+		x_min[b] = changed ? 0 : BADGER_WIDTH;
+		x_max[b] = changed ? BADGER_WIDTH - 1 : -1;
+	}
+
+	return fb_bands_to_regions(x_min, x_max, regions, max_regions);
+}
+
+void fb_copy_region(uint8_t *dst, const uint8_t *src, const struct fb_region *region)
+{
+	int x0 = region->x < 0 ? 0 : region->x;
+	int x1 = region->x + region->w > BADGER_WIDTH ? BADGER_WIDTH : region->x + region->w;
+	int b0 = region->y < 0 ? 0 : region->y / 8;
+	int b1 = region->y + region->h > BADGER_HEIGHT ? FB_BANDS : (region->y + region->h + 7) / 8;
+
+	if ((x1 <= x0) || (b1 <= b0)) {
+		return;
+	}
+
+	for (int x = x0; x < x1; x++) {
+		memcpy(&dst[x * FB_BANDS + b0], &src[x * FB_BANDS + b0], b1 - b0);
+	}
+}
+
+bool fb_region_snap(struct fb_region *region)
+{
+	int x0 = region->x < 0 ? 0 : region->x;
+	int x1 = region->x + region->w > BADGER_WIDTH ? BADGER_WIDTH : region->x + region->w;
+	int y0 = region->y < 0 ? 0 : region->y & ~7;
+	int y1 = region->y + region->h > BADGER_HEIGHT ? BADGER_HEIGHT : (region->y + region->h + 7) & ~7;
+
+	if ((x1 <= x0) || (y1 <= y0)) {
+		return false;
+	}
+
+	*region = (struct fb_region){ .x = x0, .y = y0, .w = x1 - x0, .h = y1 - y0 };
+
+	return true;
+}
+
+bool fb_region_touches(const struct fb_region *a, const struct fb_region *b)
+{
+	return (a->x <= b->x + b->w) && (b->x <= a->x + a->w) &&
+		(a->y <= b->y + b->h) && (b->y <= a->y + a->h);
+}
+
+void fb_region_union(struct fb_region *a, const struct fb_region *b)
+{
+	int x0 = a->x < b->x ? a->x : b->x;
+	int y0 = a->y < b->y ? a->y : b->y;
+	int x1 = (a->x + a->w) > (b->x + b->w) ? (a->x + a->w) : (b->x + b->w);
+	int y1 = (a->y + a->h) > (b->y + b->h) ? (a->y + a->h) : (b->y + b->h);
+
+	*a = (struct fb_region){ .x = x0, .y = y0, .w = x1 - x0, .h = y1 - y0 };
+}
+
+void fb_dirty_add(struct fb_dirty *dirty, int x, int y, int w, int h)
+{
+	struct fb_region region = { x, y, w, h };
+
+	if (!fb_region_snap(&region)) {
+		return;
+	}
+
+	for ( ;; ) {
+		// Fold in everything it touches. Growing can make it touch
+		// ones which were already checked, so start again each time.
+		for (int i = 0; i < dirty->n; ) {
+			if (fb_region_touches(&dirty->regions[i], &region)) {
+				fb_region_union(&region, &dirty->regions[i]);
+				dirty->regions[i] = dirty->regions[--dirty->n];
+				i = 0;
+			} else {
+				i++;
+			}
+		}
+
+		if (dirty->n < FB_DIRTY_MAX) {
+			break;
+		}
+
+		// No room, so merge with whichever adds the least area
+		int best = 0, best_growth = INT_MAX;
+		for (int i = 0; i < dirty->n; i++) {
+			struct fb_region u = region;
+
+			fb_region_union(&u, &dirty->regions[i]);
+
+			int growth = u.w * u.h - dirty->regions[i].w * dirty->regions[i].h;
+			if (growth < best_growth) {
+				best = i;
+				best_growth = growth;
+			}
+		}
+
+		fb_region_union(&region, &dirty->regions[best]);
+		dirty->regions[best] = dirty->regions[--dirty->n];
+	}
+
+	dirty->regions[dirty->n++] = region;
+}
@@ -0,0 +1,82 @@
+#ifndef __FB_DIFF_H__
+#define __FB_DIFF_H__
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "badger.h"
+
+/*
+ * Framebuffers here are in the UC8151's layout: column-major, with each byte
+ * holding 8 rows. Partial updates have to cover whole bytes, so regions are
+ * always made of whole 8-row bands.
+ */
+#define FB_SIZE  (BADGER_WIDTH * BADGER_HEIGHT / 8)
+#define FB_BANDS (BADGER_HEIGHT / 8)
+
+struct fb_region {
+	int x, y, w, h;
+};
+
+// Find the regions where 'fb' differs from 'shadow'. Runs of changed bands
+// are merged until there are at most 'max_regions'.
+// Returns the number of regions, 0 if nothing changed.
+int fb_diff(const uint8_t *fb, const uint8_t *shadow, struct fb_region *regions, int max_regions);
+
+/*
+ * The panel holds its image with the power off, but the shadow framebuffer
+ * doesn't survive. A fingerprint is small enough to keep in flash instead,
+ * and still says which bands changed.
+ */
+struct fb_fingerprint {
+	uint32_t bands[FB_BANDS];
+};
+
+void fb_fingerprint(const uint8_t *fb, struct fb_fingerprint *fp);
+
+// Like fb_diff(), but against a fingerprint, so regions are always full-width
+int fb_diff_fingerprint(const uint8_t *fb, const struct fb_fingerprint *fp,
+		struct fb_region *regions, int max_regions);
+
+// Copy 'region' of 'src' into 'dst', widened to whole bands
+void fb_copy_region(uint8_t *dst, const uint8_t *src, const struct fb_region *region);
+
+// Widen 'region' to whole bands and clip it to the screen. Returns false if
+// there's nothing left.
+bool fb_region_snap(struct fb_region *region);
+
+// Whether 'a' and 'b' overlap or share an edge
+bool fb_region_touches(const struct fb_region *a, const struct fb_region *b);
+
+// Grow 'a' to cover 'b' too
+void fb_region_union(struct fb_region *a, const struct fb_region *b);
+
+/*
+ * Collects regions to be presented together, from any rectangles. Each is
+ * snapped to whole bands, and ones which overlap or touch are merged, so
+ * they can go out in as few partial updates as possible. If there are more
+ * than FB_DIRTY_MAX apart, the ones which grow the least get merged anyway.
+ */
+#define FB_DIRTY_MAX 3
+
+struct fb_dirty {
+	int n;
+	struct fb_region regions[FB_DIRTY_MAX];
+};
+
+static inline void fb_dirty_clear(struct fb_dirty *dirty)
+{
+	dirty->n = 0;
+}
+
+void fb_dirty_add(struct fb_dirty *dirty, int x, int y, int w, int h);
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif /* __FB_DIFF_H__ */
@@ -0,0 +1,82 @@
+#include <string.h>
+
+#include "fb_diff.h"
+#include "fb_fill.h"
+
+// fb_pen_pattern() for every pen, for columns 0 to 3. The dither repeats
+// every 4 rows and columns, so an 8-row byte holds two repeats.
+static const uint8_t pen_patterns[16][4] = {
+	{ 0xff, 0xff, 0xff, 0xff },
+	{ 0x77, 0xff, 0xff, 0xff },
+	{ 0x77, 0xff, 0xdd, 0xff },
+	{ 0x77, 0xff, 0x55, 0xff },
+	{ 0x55, 0xff, 0x55, 0xff },
+	{ 0x55, 0xbb, 0x55, 0xff },
+	{ 0x55, 0xbb, 0x55, 0xee },
+	{ 0x55, 0xbb, 0x55, 0xaa },
+	{ 0x55, 0xaa, 0x55, 0xaa },
+	{ 0x55, 0x22, 0x55, 0xaa },
+	{ 0x55, 0x22, 0x55, 0x88 },
+	{ 0x55, 0x22, 0x55, 0x00 },
+	{ 0x55, 0x00, 0x55, 0x00 },
+	{ 0x11, 0x00, 0x55, 0x00 },
+	{ 0x11, 0x00, 0x44, 0x00 },
+	{ 0x00, 0x00, 0x00, 0x00 },
+};
+
+uint8_t fb_pen_pattern(uint8_t pen, int32_t x)
+{
+	return pen_patterns[pen > 15 ? 15 : pen][x & 0x3];
+}
+
+void fb_fill(uint8_t *fb, uint8_t pen)
+{
+	if ((pen == 0) || (pen >= 15)) {
+		memset(fb, fb_pen_pattern(pen, 0), FB_SIZE);
+		return;
+	}
+
+	for (int x = 0; x < BADGER_WIDTH; x++) {
+		memset(&fb[x * FB_BANDS], fb_pen_pattern(pen, x), FB_BANDS);
+	}
+}
+
+void fb_fill_rect(uint8_t *fb, int32_t x, int32_t y, int32_t w, int32_t h, uint8_t pen)
+{
+	if (x < 0) {
+		w += x;
+		x = 0;
+	}
+	if (y < 0) {
+		h += y;
+		y = 0;
+	}
+	if (x + w > BADGER_WIDTH) {
+		w = BADGER_WIDTH - x;
+	}
+	if (y + h > BADGER_HEIGHT) {
+		h = BADGER_HEIGHT - y;
+	}
+	if ((w <= 0) || (h <= 0)) {
+		return;
+	}
+
+	int b0 = y / 8, b1 = (y + h - 1) / 8;
+	uint8_t top = 0xff >> (y & 0x7);
+	uint8_t bottom = 0xff << (7 - ((y + h - 1) & 0x7));
+
+	if (b0 == b1) {
+		top &= bottom;
+	}
+
+	for (int32_t cx = x; cx < x + w; cx++) {
+		uint8_t *col = &fb[cx * FB_BANDS];
+		uint8_t pattern = fb_pen_pattern(pen, cx);
+
+		col[b0] = (col[b0] & ~top) | (pattern & top);
+		if (b1 > b0) {
+			memset(&col[b0 + 1], pattern, b1 - b0 - 1);
+			col[b1] = (col[b1] & ~bottom) | (pattern & bottom);
+		}
+	}
+}
@@ -0,0 +1,31 @@
+#ifndef __FB_FILL_H__
+#define __FB_FILL_H__
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#include <stdint.h>
+
+/*
+ * Pens are dithered with the Badger2040 library's 4x4 ordered dither. A
+ * framebuffer byte is 8 rows of one column, so the pattern for any whole
+ * byte only depends on the pen and the column, and filling is whole bytes
+ * with masked bytes only at the top and bottom of a rectangle.
+ */
+
+// 8 rows of the pen's dither pattern for column 'x', starting at a band.
+// Set bits are black, like the framebuffer.
+uint8_t fb_pen_pattern(uint8_t pen, int32_t x);
+
+// Fill the whole framebuffer with 'pen'
+void fb_fill(uint8_t *fb, uint8_t pen);
+
+// Fill a rectangle with 'pen', clipped to the screen
+void fb_fill_rect(uint8_t *fb, int32_t x, int32_t y, int32_t w, int32_t h, uint8_t pen);
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif /* __FB_FILL_H__ */
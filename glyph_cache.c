@@ -0,0 +1,291 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "littlefs/lfs.h"
+
+#include "fb_diff.h"
+#include "fb_fill.h"
+#include "glyph_cache.h"
+#include "hash.h"
+
+#define GLYPH_CACHE_MAGIC   0x43474255 // "UBGC"
+#define GLYPH_CACHE_VERSION 3
+
+struct glyph_cache_header {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t n_slots;
+	uint32_t pool_used;
+};
+
+static struct glyph slots[GLYPH_CACHE_SLOTS];
+static int n_glyphs;
+static uint8_t pool[GLYPH_CACHE_POOL_SIZE];
+static uint32_t pool_used;
+
+struct glyph_key glyph_key(uint32_t font, int32_t size, uint8_t thickness, unsigned char c)
+{
+	struct glyph_key key;
+
+	memset(&key, 0, sizeof(key));
+	key.font = font;
+	key.size = size;
+	key.thickness = thickness;
+	key.c = c;
+	key.valid = 1;
+
+	return key;
+}
+
+static struct glyph *glyph_cache_slot(const struct glyph_key *key)
+{
+	uint32_t idx = fnv1a_update(FNV1A_INIT, key, sizeof(*key)) & (GLYPH_CACHE_SLOTS - 1);
+
+	// The table is never allowed to fill up, so this always finds a match
+	// or an empty slot
+	while (slots[idx].key.valid && memcmp(&slots[idx].key, key, sizeof(*key))) {
+		idx = (idx + 1) & (GLYPH_CACHE_SLOTS - 1);
+	}
+
+	return &slots[idx];
+}
+
+const struct glyph *glyph_cache_find(const struct glyph_key *key)
+{
+	struct glyph *g = glyph_cache_slot(key);
+
+	return g->key.valid ? g : NULL;
+}
+
+void glyph_cache_clear(void)
+{
+	memset(slots, 0, sizeof(slots));
+	n_glyphs = 0;
+	pool_used = 0;
+}
+
+struct glyph *glyph_cache_add(const struct glyph_key *key, int ox, int oy, int w, int h, int advance)
+{
+	uint32_t size = w * ((h + 7) / 8);
+
+	if ((w < 0) || (h < 0) || (size > GLYPH_CACHE_POOL_SIZE)) {
+		return NULL;
+	}
+
+	// Keep the table at most 3/4 full so probing stays short
+	if ((n_glyphs >= (GLYPH_CACHE_SLOTS * 3) / 4) || (size > GLYPH_CACHE_POOL_SIZE - pool_used)) {
+		return NULL;
+	}
+
+	struct glyph *g = glyph_cache_slot(key);
+	g->key = *key;
+	g->ox = ox;
+	g->oy = oy;
+	g->w = w;
+	g->h = h;
+	g->advance = advance;
+	g->offset = pool_used;
+
+	memset(&pool[pool_used], 0, size);
+	pool_used += size;
+	n_glyphs++;
+
+	return g;
+}
+
+static void glyph_mask_stamp(struct glyph *g, int32_t x, int32_t y, uint8_t thickness)
+{
+	int stride = (g->h + 7) / 8;
+	uint8_t *mask = &pool[g->offset];
+	int32_t ht = thickness / 2;
+
+	for (int32_t sx = x - ht; sx < x - ht + thickness; sx++) {
+		if ((sx < 0) || (sx >= g->w)) {
+			continue;
+		}
+
+		for (int32_t sy = y - ht; sy < y - ht + thickness; sy++) {
+			if ((sy < 0) || (sy >= g->h)) {
+				continue;
+			}
+
+			mask[sx * stride + (sy / 8)] |= 0x80 >> (sy & 0x7);
+		}
+	}
+}
+
+void glyph_mask_line(struct glyph *g, int32_t x1, int32_t y1, int32_t x2, int32_t y2, uint8_t thickness)
+{
+	int32_t dx = x2 > x1 ? x2 - x1 : x1 - x2, sx = x1 < x2 ? 1 : -1;
+	int32_t dy = y2 > y1 ? y1 - y2 : y2 - y1, sy = y1 < y2 ? 1 : -1;
+	int32_t err = dx + dy;
+
+	for ( ;; ) {
+		glyph_mask_stamp(g, x1, y1, thickness);
+		if ((x1 == x2) && (y1 == y2)) {
+			break;
+		}
+
+		int32_t e2 = 2 * err;
+		if (e2 >= dy) {
+			err += dy;
+			x1 += sx;
+		}
+		if (e2 <= dx) {
+			err += dx;
+			y1 += sy;
+		}
+	}
+}
+
+void glyph_blit(uint8_t *fb, const struct glyph *g, int32_t x, int32_t y, uint8_t pen)
+{
+	glyph_blit_cols(fb, g, x, y, pen, 0, BADGER_WIDTH);
+}
+
+void glyph_blit_cols(uint8_t *fb, const struct glyph *g, int32_t x, int32_t y, uint8_t pen,
+		int x0, int x1)
+{
+	const uint8_t *mask = &pool[g->offset];
+	int stride = (g->h + 7) / 8;
+	int32_t gx = x + g->ox;
+	int32_t gy = y + g->oy;
+	// Floor, for glyphs hanging off the top
+	int32_t band0 = gy >= 0 ? gy / 8 : -((7 - gy) / 8);
+	int shift = gy - band0 * 8;
+	uint8_t patterns[4];
+
+	for (int i = 0; i < 4; i++) {
+		patterns[i] = fb_pen_pattern(pen, i);
+	}
+
+	for (int cx = 0; cx < g->w; cx++) {
+		int32_t fx = gx + cx;
+		if ((fx < x0) || (fx >= x1)) {
+			continue;
+		}
+
+		uint8_t *col = &fb[fx * FB_BANDS];
+		uint8_t pattern = patterns[fx & 0x3];
+
+		for (int mb = 0; mb < stride; mb++) {
+			uint8_t m = mask[cx * stride + mb];
+			if (!m) {
+				continue;
+			}
+
+			int32_t b = band0 + mb;
+			uint8_t hi = m >> shift;
+			uint8_t lo = shift ? (uint8_t)(m << (8 - shift)) : 0;
+
+			if (hi && (b >= 0) && (b < FB_BANDS)) {
+				col[b] = (col[b] & ~hi) | (pattern & hi);
+			}
+			if (lo && (b + 1 >= 0) && (b + 1 < FB_BANDS)) {
+				col[b + 1] = (col[b + 1] & ~lo) | (pattern & lo);
+			}
+		}
+	}
+}
+
+int glyph_cache_save(lfs_t *lfs, const char *path)
+{
+	struct glyph_cache_header hdr = {
+		.magic = GLYPH_CACHE_MAGIC,
+		.version = GLYPH_CACHE_VERSION,
+		.n_slots = GLYPH_CACHE_SLOTS,
+		.pool_used = pool_used,
+	};
+	lfs_file_t fp;
+	int res;
+
+	res = lfs_file_open(lfs, &fp, path, LFS_O_CREAT | LFS_O_TRUNC | LFS_O_WRONLY);
+	if (res) {
+		return res;
+	}
+
+	res = lfs_file_write(lfs, &fp, &hdr, sizeof(hdr));
+	if (res != sizeof(hdr)) {
+		goto err_close;
+	}
+
+	res = lfs_file_write(lfs, &fp, slots, sizeof(slots));
+	if (res != sizeof(slots)) {
+		goto err_close;
+	}
+
+	res = lfs_file_write(lfs, &fp, pool, pool_used);
+	if (res != pool_used) {
+		goto err_close;
+	}
+
+	res = lfs_file_close(lfs, &fp);
+	printf("saved %d glyphs, %d bytes: %d\n", n_glyphs, pool_used, res);
+
+	return res;
+
+err_close:
+	lfs_file_close(lfs, &fp);
+	lfs_remove(lfs, path);
+	return res < 0 ? res : LFS_ERR_IO;
+}
+
+int glyph_cache_load(lfs_t *lfs, const char *path)
+{
+	struct glyph_cache_header hdr;
+	lfs_file_t fp;
+	int res;
+
+	glyph_cache_clear();
+
+	res = lfs_file_open(lfs, &fp, path, LFS_O_RDONLY);
+	if (res) {
+		return res;
+	}
+
+	res = lfs_file_read(lfs, &fp, &hdr, sizeof(hdr));
+	if ((res != sizeof(hdr)) || (hdr.magic != GLYPH_CACHE_MAGIC) ||
+	    (hdr.version != GLYPH_CACHE_VERSION) || (hdr.n_slots != GLYPH_CACHE_SLOTS) ||
+	    (hdr.pool_used > GLYPH_CACHE_POOL_SIZE)) {
+		res = LFS_ERR_CORRUPT;
+		goto err_close;
+	}
+
+	res = lfs_file_read(lfs, &fp, slots, sizeof(slots));
+	if (res != sizeof(slots)) {
+		res = LFS_ERR_CORRUPT;
+		goto err_close;
+	}
+
+	res = lfs_file_read(lfs, &fp, pool, hdr.pool_used);
+	if (res != hdr.pool_used) {
+		res = LFS_ERR_CORRUPT;
+		goto err_close;
+	}
+
+	lfs_file_close(lfs, &fp);
+
+	// Don't trust any glyph which points outside the pool
+	pool_used = hdr.pool_used;
+	for (int i = 0; i < GLYPH_CACHE_SLOTS; i++) {
+		struct glyph *g = &slots[i];
+
+		if (!g->key.valid) {
+			continue;
+		}
+
+		if (g->offset + g->w * ((g->h + 7) / 8) > pool_used) {
+			glyph_cache_clear();
+			return LFS_ERR_CORRUPT;
+		}
+
+		n_glyphs++;
+	}
+
+	return 0;
+
+err_close:
+	lfs_file_close(lfs, &fp);
+	glyph_cache_clear();
+	return res;
+}
@@ -0,0 +1,84 @@
+#ifndef __GLYPH_CACHE_H__
+#define __GLYPH_CACHE_H__
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "littlefs/lfs.h"
+
+/*
+ * Stroking a Hershey glyph means float maths and a thickness x thickness
+ * square per point on every line. Pages use the same few sizes over and over,
+ * so glyphs are rasterised once into 1bpp masks and then blitted.
+ *
+ * Masks are in the framebuffer's layout (column-major, 8 rows per byte, MSB
+ * at the top), so blitting is a shift and mask per byte.
+ *
+ * The cache is filled during a USB sync and saved to littlefs, so that waking
+ * on battery doesn't have to stroke anything.
+ *
+ * Once it's full nothing else is added, rather than throwing glyphs out: the
+ * sync caches one page at a time (main.txt first), so the saved set is then
+ * whole pages, not bits of the last few. It's sized for a few pages of text
+ * at two or three sizes; anything beyond that is stroked.
+ */
+#define GLYPH_CACHE_SLOTS     256
+#define GLYPH_CACHE_POOL_SIZE (16 * 1024)
+
+// Glyphs are stroked relative to here, so that all coordinates are positive
+// and truncate the same way wherever the glyph is eventually drawn
+#define GLYPH_ORIGIN 1024
+
+struct glyph_key {
+	// Hash of the font name, 0 for the default font
+	uint32_t font;
+	// Text size, fixed point
+	int32_t size;
+	uint8_t thickness;
+	uint8_t c;
+	// Always 1, so that an empty slot never matches
+	uint8_t valid;
+	uint8_t reserved;
+};
+
+struct glyph {
+	struct glyph_key key;
+	// Offset of the mask's top-left from the glyph origin
+	int16_t ox, oy;
+	uint16_t w, h;
+	int16_t advance;
+	// Offset of the mask in the pool
+	uint16_t offset;
+};
+
+struct glyph_key glyph_key(uint32_t font, int32_t size, uint8_t thickness, unsigned char c);
+
+const struct glyph *glyph_cache_find(const struct glyph_key *key);
+
+// Add an empty (zeroed) w x h mask for 'key'. Returns NULL if the cache is
+// full, or the glyph is too big to cache at all.
+struct glyph *glyph_cache_add(const struct glyph_key *key, int ox, int oy, int w, int h, int advance);
+
+// Stroke a line into a glyph's mask, in mask coordinates, stamping a
+// 'thickness' square at each point like Badger2040::pixel() does
+void glyph_mask_line(struct glyph *g, int32_t x1, int32_t y1, int32_t x2, int32_t y2, uint8_t thickness);
+
+// Draw glyph 'g' with its origin at 'x', 'y' into 'fb', dithered with 'pen'
+void glyph_blit(uint8_t *fb, const struct glyph *g, int32_t x, int32_t y, uint8_t pen);
+// The same, but only touching framebuffer columns 'x0' to 'x1' - 1
+void glyph_blit_cols(uint8_t *fb, const struct glyph *g, int32_t x, int32_t y, uint8_t pen,
+		int x0, int x1);
+
+void glyph_cache_clear(void);
+
+int glyph_cache_save(lfs_t *lfs, const char *path);
+int glyph_cache_load(lfs_t *lfs, const char *path);
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif /* __GLYPH_CACHE_H__ */
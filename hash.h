@@ -0,0 +1,22 @@
+#ifndef __HASH_H__
+#define __HASH_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// 32-bit FNV-1a, which can be computed incrementally
+#define FNV1A_INIT 0x811c9dc5
+
+static inline uint32_t fnv1a_update(uint32_t hash, const void *data, size_t size)
+{
+	const uint8_t *p = (const uint8_t *)data;
+
+	while (size--) {
+		hash ^= *p++;
+		hash *= 0x01000193;
+	}
+
+	return hash;
+}
+
+#endif /* __HASH_H__ */
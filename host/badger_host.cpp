@@ -0,0 +1,453 @@
+/*
+ * Stand-in for badger.cpp on the host: draws into a software framebuffer
+ * using the same pen dithering and Hershey fonts as the Badger2040 library,
+ * so that measuring and drawing cost roughly what it does on the badge.
+ * Anything to do with the panel or buttons is a no-op.
+ */
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "libraries/hershey_fonts/hershey_fonts.hpp"
+
+#include "badger_host.h"
+#include "fb_blit.h"
+#include "fb_diff.h"
+#include "fb_fill.h"
+#include "glyph_cache.h"
+#include "hash.h"
+#include "text_metrics.h"
+
+static uint8_t framebuffer[FB_SIZE];
+static uint8_t front[FB_SIZE];
+static bool front_valid;
+static struct fb_fingerprint fingerprint;
+static bool fingerprint_valid;
+static struct fb_dirty dirty;
+static uint8_t pen_value;
+static uint8_t thickness_value = 1;
+// Looked up on first use, as the font table is itself a static
+static const hershey::font_t *font;
+static uint32_t font_id;
+static uint32_t update_count;
+
+static bool dither_value(int32_t x, int32_t y, uint8_t p)
+{
+	// Ordered dither, as used by the Badger2040 library
+	static const uint8_t odm[16] = { 0, 8, 2, 10, 12, 4, 14, 6, 3, 11, 1, 9, 15, 7, 13, 5 };
+
+	if (p == 0) {
+		return 1;
+	} else if (p == 15) {
+		return 0;
+	}
+
+	return p <= odm[(x & 0x3) | ((y & 0x3) << 2)];
+}
+
+static const hershey::font_t *current_font(void)
+{
+	if (!font) {
+		font = hershey::font("sans");
+	}
+
+	return font;
+}
+
+static void fb_pixel(int32_t x, int32_t y, bool v)
+{
+	if ((x < 0) || (y < 0) || (x >= BADGER_WIDTH) || (y >= BADGER_HEIGHT)) {
+		return;
+	}
+
+	uint8_t *p = &framebuffer[(y / 8) + (x * (BADGER_HEIGHT / 8))];
+	uint8_t o = 7 - (y & 0x7);
+
+	*p = (*p & ~(1 << o)) | ((v ? 1 : 0) << o);
+}
+
+const uint8_t *badger_host_framebuffer(void)
+{
+	return framebuffer;
+}
+
+uint32_t badger_host_update_count(void)
+{
+	return update_count;
+}
+
+int badger_host_write_pbm(const char *path)
+{
+	FILE *fp = fopen(path, "wb");
+	if (!fp) {
+		return -1;
+	}
+
+	fprintf(fp, "P4\n%d %d\n", BADGER_WIDTH, BADGER_HEIGHT);
+
+	for (int y = 0; y < BADGER_HEIGHT; y++) {
+		uint8_t row[(BADGER_WIDTH + 7) / 8] = { 0 };
+
+		for (int x = 0; x < BADGER_WIDTH; x++) {
+			uint8_t b = framebuffer[(y / 8) + (x * (BADGER_HEIGHT / 8))];
+			if (b & (1 << (7 - (y & 0x7)))) {
+				row[x / 8] |= 0x80 >> (x & 0x7);
+			}
+		}
+
+		fwrite(row, sizeof(row), 1, fp);
+	}
+
+	return fclose(fp);
+}
+
+void badger_init(void)
+{
+	memset(framebuffer, 0, sizeof(framebuffer));
+}
+
+void badger_present(void)
+{
+	update_count++;
+	fb_dirty_clear(&dirty);
+
+	memcpy(front, framebuffer, sizeof(front));
+	front_valid = true;
+}
+
+void badger_dirty(int x, int y, int w, int h)
+{
+	fb_dirty_add(&dirty, x, y, w, h);
+}
+
+void badger_present_dirty(void)
+{
+	for (int i = 0; i < dirty.n; i++) {
+		update_count++;
+
+		fb_copy_region(front, framebuffer, &dirty.regions[i]);
+	}
+
+	fb_dirty_clear(&dirty);
+}
+
+void badger_present_region(int x, int y, int w, int h)
+{
+	badger_dirty(x, y, w, h);
+	badger_present_dirty();
+}
+
+// Does the same diff as the badge, so that it shows up in the timings
+void badger_present_changed(void)
+{
+	struct fb_region regions[3];
+	int n;
+
+	if (front_valid) {
+		n = fb_diff(framebuffer, front, regions, 3);
+	} else if (fingerprint_valid) {
+		n = fb_diff_fingerprint(framebuffer, &fingerprint, regions, 3);
+	} else {
+		badger_present();
+		return;
+	}
+	update_count += n;
+
+	memcpy(front, framebuffer, sizeof(front));
+	front_valid = true;
+	fb_dirty_clear(&dirty);
+}
+
+void badger_display_done(void)
+{
+}
+
+void badger_fence(void)
+{
+}
+
+bool badger_get_fingerprint(struct fb_fingerprint *fp)
+{
+	if (front_valid) {
+		fb_fingerprint(front, fp);
+		return true;
+	} else if (fingerprint_valid) {
+		*fp = fingerprint;
+		return true;
+	}
+
+	return false;
+}
+
+void badger_set_fingerprint(const struct fb_fingerprint *fp)
+{
+	fingerprint = *fp;
+	fingerprint_valid = true;
+}
+
+void badger_refresh_clean(void)
+{
+}
+
+uint32_t badger_update_time()
+{
+	return 0;
+}
+
+void badger_halt()
+{
+}
+
+void badger_sleep()
+{
+}
+
+bool badger_is_busy()
+{
+	return false;
+}
+
+void badger_power_off()
+{
+}
+
+void badger_invert(bool invert)
+{
+}
+
+// state
+void badger_led(uint8_t brightness)
+{
+}
+
+void badger_font(const char *name)
+{
+	if (hershey::has_font(name)) {
+		font = hershey::font(name);
+		font_id = fnv1a_update(FNV1A_INIT, name, strlen(name));
+	}
+}
+
+void badger_pen(uint8_t pen)
+{
+	pen_value = pen;
+}
+
+void badger_thickness(uint8_t thickness)
+{
+	thickness_value = thickness;
+}
+
+// inputs (buttons: A, B, C, D, E, USER)
+bool badger_pressed(uint8_t button)
+{
+	return false;
+}
+
+bool badger_pressed_to_wake(uint8_t button)
+{
+	return false;
+}
+
+void badger_wait_for_press()
+{
+}
+
+void badger_update_button_states()
+{
+}
+
+uint32_t badger_button_states()
+{
+	return 0;
+}
+
+// drawing primitives
+void badger_clear()
+{
+	fb_fill(framebuffer, pen_value);
+}
+
+void badger_pixel(int32_t x, int32_t y)
+{
+	if (thickness_value == 1) {
+		fb_pixel(x, y, dither_value(x, y, pen_value));
+		return;
+	}
+
+	int32_t ht = thickness_value / 2;
+	for (int32_t sy = 0; sy < thickness_value; sy++) {
+		for (int32_t sx = 0; sx < thickness_value; sx++) {
+			fb_pixel(x + sx - ht, y + sy - ht, dither_value(x + sx - ht, y + sy - ht, pen_value));
+		}
+	}
+}
+
+void badger_line(int32_t x1, int32_t y1, int32_t x2, int32_t y2)
+{
+	int32_t dx = abs(x2 - x1), sx = x1 < x2 ? 1 : -1;
+	int32_t dy = -abs(y2 - y1), sy = y1 < y2 ? 1 : -1;
+	int32_t err = dx + dy;
+
+	for ( ;; ) {
+		badger_pixel(x1, y1);
+		if ((x1 == x2) && (y1 == y2)) {
+			break;
+		}
+
+		int32_t e2 = 2 * err;
+		if (e2 >= dy) {
+			err += dy;
+			x1 += sx;
+		}
+		if (e2 <= dx) {
+			err += dx;
+			y1 += sy;
+		}
+	}
+}
+
+void badger_rectangle(int32_t x, int32_t y, int32_t w, int32_t h)
+{
+	fb_fill_rect(framebuffer, x, y, w, h, pen_value);
+}
+
+void badger_icon(const uint8_t *data, int sheet_width, int icon_size, int index, int dx, int dy)
+{
+	badger_subimage(data, sheet_width, index * icon_size, 0, icon_size, icon_size, dx, dy);
+}
+
+void badger_image_fullscreen(const uint8_t *data)
+{
+	badger_image(data, BADGER_WIDTH, BADGER_HEIGHT, 0, 0);
+}
+
+void badger_image(const uint8_t *data, int w, int h, int x, int y)
+{
+	badger_subimage(data, w, 0, 0, w, h, x, y);
+}
+
+void badger_subimage(const uint8_t *data, int stride, int sx, int sy, int dw, int dh, int dx, int dy)
+{
+	if (thickness_value == 1) {
+		fb_blit_image(framebuffer, data, stride, sx, sy, dw, dh, dx, dy);
+		return;
+	}
+
+	for (int y = 0; y < dh; y++) {
+		for (int x = 0; x < dw; x++) {
+			int ix = sx + x, iy = sy + y;
+			uint8_t b = data[(ix / 8) + (iy * (stride / 8))] & (0x80 >> (ix & 0x7));
+
+			fb_pixel(dx + x, dy + y, b == 0);
+		}
+	}
+}
+
+static const struct glyph *cached_glyph(unsigned char c, int32_t s)
+{
+	struct glyph_key key = glyph_key(font_id, s, thickness_value, c);
+	const struct glyph *cached = glyph_cache_find(&key);
+	if (cached) {
+		return cached;
+	}
+
+	int32_t min_x = INT32_MAX, min_y = INT32_MAX, max_x = INT32_MIN, max_y = INT32_MIN;
+	int32_t advance = hershey::glyph(current_font(), [&](int32_t x1, int32_t y1, int32_t x2, int32_t y2) {
+		min_x = std::min(min_x, std::min(x1, x2));
+		min_y = std::min(min_y, std::min(y1, y2));
+		max_x = std::max(max_x, std::max(x1, x2));
+		max_y = std::max(max_y, std::max(y1, y2));
+	}, c, GLYPH_ORIGIN, GLYPH_ORIGIN, badger_fixed_to_float(s), 0.0f);
+
+	int32_t ht = thickness_value / 2;
+	struct glyph *g;
+	if (max_x < min_x) {
+		g = glyph_cache_add(&key, 0, 0, 0, 0, advance);
+	} else {
+		g = glyph_cache_add(&key, min_x - ht - GLYPH_ORIGIN, min_y - ht - GLYPH_ORIGIN,
+				max_x - min_x + thickness_value, max_y - min_y + thickness_value, advance);
+	}
+	if (!g) {
+		return NULL;
+	}
+
+	hershey::glyph(current_font(), [&](int32_t x1, int32_t y1, int32_t x2, int32_t y2) {
+		glyph_mask_line(g, x1 - min_x + ht, y1 - min_y + ht, x2 - min_x + ht, y2 - min_y + ht, thickness_value);
+	}, c, GLYPH_ORIGIN, GLYPH_ORIGIN, badger_fixed_to_float(s), 0.0f);
+
+	return g;
+}
+
+void badger_text(const char *message, int32_t x, int32_t y, int32_t s, int32_t a, uint8_t letter_spacing)
+{
+	if (a != 0) {
+		hershey::text(current_font(), [](int32_t x1, int32_t y1, int32_t x2, int32_t y2) {
+			badger_line(x1, y1, x2, y2);
+		}, std::string(message), x, y, badger_fixed_to_float(s), badger_fixed_to_float(a), letter_spacing);
+		return;
+	}
+
+	for (const char *c = message; *c; c++) {
+		const struct glyph *g = cached_glyph(*c, s);
+		if (g) {
+			glyph_blit(framebuffer, g, x, y, pen_value);
+			x += g->advance + letter_spacing;
+		} else {
+			x += badger_glyph(*c, x, y, s, 0) + letter_spacing;
+		}
+	}
+}
+
+void badger_cache_text(const char *message, int32_t s)
+{
+	for (const char *c = message; *c; c++) {
+		cached_glyph(*c, s);
+	}
+}
+
+void badger_image_cols(const uint8_t *data, int w, int h, int x, int y, int x0, int x1)
+{
+	fb_blit_image_cols(framebuffer, data, w, 0, 0, w, h, x, y, x0, x1);
+}
+
+bool badger_text_cols(const char *message, int32_t x, int32_t y, int32_t s, uint8_t pen,
+		uint8_t thickness, uint8_t letter_spacing, int x0, int x1)
+{
+	for (const char *c = message; *c; c++) {
+		struct glyph_key key = glyph_key(font_id, s, thickness, *c);
+		const struct glyph *g = glyph_cache_find(&key);
+		if (!g) {
+			return false;
+		}
+
+		glyph_blit_cols(framebuffer, g, x, y, pen, x0, x1);
+		x += g->advance + letter_spacing;
+	}
+
+	return true;
+}
+
+int32_t badger_glyph(unsigned char c, int32_t x, int32_t y, int32_t s, int32_t a)
+{
+	return hershey::glyph(current_font(), [](int32_t x1, int32_t y1, int32_t x2, int32_t y2) {
+		badger_line(x1, y1, x2, y2);
+	}, c, x, y, badger_fixed_to_float(s), badger_fixed_to_float(a));
+}
+
+const struct text_metrics *badger_text_metrics(int32_t s)
+{
+	return text_metrics_get(current_font(), font_id, s);
+}
+
+int32_t badger_measure_text(const char *message, int32_t s, uint8_t letter_spacing)
+{
+	return text_metrics_measure(badger_text_metrics(s), message, letter_spacing);
+}
+
+int32_t badger_measure_glyph(unsigned char c, int32_t s)
+{
+	return hershey::measure_glyph(current_font(), c, badger_fixed_to_float(s));
+}
@@ -0,0 +1,26 @@
+#ifndef __BADGER_HOST_H__
+#define __BADGER_HOST_H__
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "badger.h"
+
+// The software framebuffer, in the same layout as the UC8151's:
+// column-major, 8 rows per byte, MSB first, 1 is black
+const uint8_t *badger_host_framebuffer(void);
+
+// Number of refreshes started by badger_present*() so far
+uint32_t badger_host_update_count(void);
+
+// Write the framebuffer out as a binary PBM
+int badger_host_write_pbm(const char *path);
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif /* __BADGER_HOST_H__ */
@@ -0,0 +1,417 @@
+/*
+ * Page pipeline benchmark
+ *
+ * Runs the same parse/layout/render/compile code as the badge against a
+ * littlefs RAM block device, and reports how long each stage takes and how
+ * much it allocates, for each page in a corpus:
+ *
+ *   page_bench [-n iterations] [-o pbm_dir] [-p] page.txt [image.bin ...]
+ *
+ * Every file given is copied into the root of the filesystem (by basename),
+ * as a USB sync would. Every .txt file is benchmarked. Timings are in
+ * microseconds of host CPU time, so only compare them against each other.
+ *
+ * -p draws pages in two halves, as when both cores are drawing on the badge.
+ */
+#include <errno.h>
+#include <getopt.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "littlefs/lfs.h"
+#include "bd/lfs_rambd.h"
+
+#include "badger_host.h"
+#include "image_store.h"
+#include "page_arena.h"
+#include "page_file.h"
+#include "render_worker.h"
+#include "screen_page.h"
+
+/*
+ * Heap accounting: the benchmark is linked with --wrap for the allocator
+ * functions, so every allocation made by the page code lands here.
+ */
+static struct {
+	size_t n_allocs;
+	size_t current;
+	size_t peak;
+} heap;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+static void heap_track_alloc(void *ptr)
+{
+	if (!ptr) {
+		return;
+	}
+
+	heap.n_allocs++;
+	heap.current += malloc_usable_size(ptr);
+	if (heap.current > heap.peak) {
+		heap.peak = heap.current;
+	}
+}
+
+void *__wrap_malloc(size_t size)
+{
+	void *ptr = __real_malloc(size);
+	heap_track_alloc(ptr);
+	return ptr;
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+	void *ptr = __real_calloc(nmemb, size);
+	heap_track_alloc(ptr);
+	return ptr;
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+	if (ptr) {
+		heap.current -= malloc_usable_size(ptr);
+	}
+
+	void *new_ptr = __real_realloc(ptr, size);
+	if (new_ptr) {
+		heap_track_alloc(new_ptr);
+	} else if (ptr) {
+		// The original block is still there
+		heap.current += malloc_usable_size(ptr);
+	}
+
+	return new_ptr;
+}
+
+void __wrap_free(void *ptr)
+{
+	if (ptr) {
+		heap.current -= malloc_usable_size(ptr);
+	}
+
+	__real_free(ptr);
+}
+
+enum stage {
+	// The text page, as on the badge before it has been synced
+	STAGE_PARSE,
+	STAGE_LAYOUT,
+	STAGE_RENDER,
+	// What a USB sync does for each page
+	STAGE_COMPILE,
+	STAGE_LOAD_COMPILED,
+	// page_load() and display: the whole battery wake path
+	STAGE_WAKE,
+	NUM_STAGES,
+};
+
+static const char *stage_names[NUM_STAGES] = {
+	[STAGE_PARSE] = "parse",
+	[STAGE_LAYOUT] = "layout",
+	[STAGE_RENDER] = "render",
+	[STAGE_COMPILE] = "compile",
+	[STAGE_LOAD_COMPILED] = "load_compiled",
+	[STAGE_WAKE] = "wake",
+};
+
+struct stage_stats {
+	int n;
+	double total_us;
+	double min_us;
+	double max_us;
+	size_t n_allocs;
+	size_t peak_heap;
+	size_t peak_arena;
+};
+
+struct stage_timer {
+	struct timespec start;
+	size_t n_allocs;
+	size_t heap_base;
+};
+
+static void stage_begin(struct stage_timer *t)
+{
+	t->n_allocs = heap.n_allocs;
+	t->heap_base = heap.current;
+	heap.peak = heap.current;
+	clock_gettime(CLOCK_MONOTONIC, &t->start);
+}
+
+static void stage_end(struct stage_timer *t, struct stage_stats *stats, struct screen_page *page)
+{
+	struct timespec end;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	double us = (end.tv_sec - t->start.tv_sec) * 1e6 + (end.tv_nsec - t->start.tv_nsec) / 1e3;
+
+	if (!stats->n || (us < stats->min_us)) {
+		stats->min_us = us;
+	}
+	if (us > stats->max_us) {
+		stats->max_us = us;
+	}
+	stats->total_us += us;
+	stats->n++;
+
+	stats->n_allocs = heap.n_allocs - t->n_allocs;
+	if (heap.peak - t->heap_base > stats->peak_heap) {
+		stats->peak_heap = heap.peak - t->heap_base;
+	}
+
+	if (page && page->arena && (page->arena->peak > stats->peak_arena)) {
+		stats->peak_arena = page->arena->peak;
+	}
+}
+
+// Same geometry as the badge's littlefs region
+static lfs_rambd_t rambd;
+static const struct lfs_rambd_config rambd_cfg = {
+	.read_size = 1,
+	.prog_size = 256,
+	.erase_size = 4096,
+	.erase_count = 16,
+};
+
+static const struct lfs_config lfs_cfg = {
+	.context = &rambd,
+	.read  = lfs_rambd_read,
+	.prog  = lfs_rambd_prog,
+	.erase = lfs_rambd_erase,
+	.sync  = lfs_rambd_sync,
+
+	.read_size = 1,
+	.prog_size = 256,
+	.block_size = 4096,
+	.block_count = 16,
+	.cache_size = 256,
+	.lookahead_size = 8,
+	.block_cycles = 500,
+};
+
+static int copy_to_lfs(lfs_t *lfs, const char *path)
+{
+	const char *name = strrchr(path, '/');
+	char buf[256];
+	lfs_file_t lfp;
+	size_t nread;
+	int res;
+
+	name = name ? name + 1 : path;
+
+	FILE *fp = fopen(path, "rb");
+	if (!fp) {
+		return -errno;
+	}
+
+	res = lfs_file_open(lfs, &lfp, name, LFS_O_CREAT | LFS_O_TRUNC | LFS_O_WRONLY);
+	if (res) {
+		fclose(fp);
+		return res;
+	}
+
+	while ((nread = fread(buf, 1, sizeof(buf), fp)) > 0) {
+		res = lfs_file_write(lfs, &lfp, buf, nread);
+		if (res != nread) {
+			res = res < 0 ? res : LFS_ERR_IO;
+			break;
+		}
+		res = 0;
+	}
+
+	fclose(fp);
+	lfs_file_close(lfs, &lfp);
+
+	return res;
+}
+
+static void bench_page(FILE *report, lfs_t *lfs, struct image_store *store, const char *name,
+		int iterations, const char *pbm_dir)
+{
+	struct stage_stats stats[NUM_STAGES] = { 0 };
+	char dst[LFS_NAME_MAX + 1];
+	struct page_diag diag;
+	struct stage_timer t;
+
+	if (page_compiled_path(dst, sizeof(dst), name)) {
+		return;
+	}
+
+	// Arena peaks are high-water marks for the life of the arena, so
+	// start them from zero for each page
+	struct page_arena *arenas[PAGE_ARENA_COUNT];
+	for (int i = 0; i < PAGE_ARENA_COUNT; i++) {
+		arenas[i] = page_arena_get();
+		arenas[i]->peak = 0;
+	}
+	for (int i = 0; i < PAGE_ARENA_COUNT; i++) {
+		page_arena_put(arenas[i]);
+	}
+
+	for (int i = 0; i < iterations; i++) {
+		struct screen_page *page;
+		int res;
+
+		stage_begin(&t);
+		page = parse_file(lfs, name);
+		stage_end(&t, &stats[STAGE_PARSE], page);
+		if (!page) {
+			fprintf(report, "%s: failed to parse\n", name);
+			return;
+		}
+
+		stage_begin(&t);
+		screen_page_layout(page);
+		stage_end(&t, &stats[STAGE_LAYOUT], page);
+
+		stage_begin(&t);
+		screen_page_display(page);
+		stage_end(&t, &stats[STAGE_RENDER], page);
+		screen_page_free(page);
+
+		stage_begin(&t);
+		res = page_compile(lfs, store, name, dst, &diag);
+		stage_end(&t, &stats[STAGE_COMPILE], NULL);
+		if (res) {
+			fprintf(report, "%s:%d: failed to compile: %s\n", name, diag.line, diag.msg);
+			return;
+		}
+
+		stage_begin(&t);
+		page = page_load_compiled(lfs, dst);
+		stage_end(&t, &stats[STAGE_LOAD_COMPILED], page);
+		screen_page_free(page);
+
+		stage_begin(&t);
+		page = page_load(lfs, name);
+		if (page) {
+			screen_page_display(page);
+		}
+		stage_end(&t, &stats[STAGE_WAKE], page);
+		screen_page_free(page);
+	}
+
+	for (int i = 0; i < NUM_STAGES; i++) {
+		struct stage_stats *s = &stats[i];
+
+		fprintf(report, "%-16s %-14s %10.1f %10.1f %10.1f %8zu %10zu %10zu\n",
+				name, stage_names[i], s->total_us / s->n, s->min_us, s->max_us,
+				s->n_allocs, s->peak_heap, s->peak_arena);
+	}
+
+	if (pbm_dir) {
+		char path[512];
+
+		snprintf(path, sizeof(path), "%s/%s.pbm", pbm_dir, name);
+		if (badger_host_write_pbm(path)) {
+			fprintf(report, "failed writing %s\n", path);
+		}
+	}
+}
+
+static bool is_text_page(const char *name)
+{
+	const char *ext = strrchr(name, '.');
+
+	return ext && (strcmp(ext, ".txt") == 0);
+}
+
+int main(int argc, char *argv[])
+{
+	static struct image_store store;
+	const char *pbm_dir = NULL;
+	int iterations = 100;
+	lfs_t lfs;
+	int opt, res;
+
+	while ((opt = getopt(argc, argv, "n:o:p")) != -1) {
+		switch (opt) {
+		case 'n':
+			iterations = atoi(optarg);
+			break;
+		case 'o':
+			pbm_dir = optarg;
+			break;
+		case 'p':
+			render_worker_start();
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-n iterations] [-o pbm_dir] [-p] file...\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if ((optind >= argc) || (iterations <= 0)) {
+		fprintf(stderr, "Usage: %s [-n iterations] [-o pbm_dir] [-p] file...\n", argv[0]);
+		return 1;
+	}
+
+	res = lfs_rambd_create(&lfs_cfg, &rambd_cfg);
+	if (!res) {
+		res = lfs_format(&lfs, &lfs_cfg);
+	}
+	if (!res) {
+		res = lfs_mount(&lfs, &lfs_cfg);
+	}
+	if (res) {
+		fprintf(stderr, "failed to set up littlefs: %d\n", res);
+		return 1;
+	}
+
+	for (int i = optind; i < argc; i++) {
+		res = copy_to_lfs(&lfs, argv[i]);
+		if (res) {
+			fprintf(stderr, "failed to copy %s: %d\n", argv[i], res);
+			return 1;
+		}
+	}
+
+	res = lfs_mkdir(&lfs, PAGE_SYS_DIR);
+	if (!res) {
+		res = image_store_begin(&store, &lfs);
+	}
+	if (res) {
+		fprintf(stderr, "failed to set up image store: %d\n", res);
+		return 1;
+	}
+
+	badger_init();
+
+	// The page code is chatty, keep the report separate from it
+	FILE *report = fdopen(dup(fileno(stdout)), "w");
+	if (!report || !freopen("/dev/null", "w", stdout)) {
+		fprintf(stderr, "failed to redirect stdout\n");
+		return 1;
+	}
+
+	fprintf(report, "%-16s %-14s %10s %10s %10s %8s %10s %10s\n",
+			"page", "stage", "mean_us", "min_us", "max_us",
+			"allocs", "peak_heap", "peak_arena");
+	fflush(report);
+
+	for (int i = optind; i < argc; i++) {
+		const char *name = strrchr(argv[i], '/');
+		name = name ? name + 1 : argv[i];
+
+		if (!is_text_page(name)) {
+			continue;
+		}
+
+		bench_page(report, &lfs, &store, name, iterations, pbm_dir);
+	}
+
+	fclose(report);
+	lfs_unmount(&lfs);
+	lfs_rambd_destroy(&lfs_cfg);
+
+	return 0;
+}
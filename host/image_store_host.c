@@ -0,0 +1,97 @@
+/*
+ * Host version of image_store.c. The generation is kept in littlefs just like
+ * on the badge, but the store itself is a RAM buffer standing in for the XIP
+ * flash region.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "littlefs/lfs.h"
+
+#include "hash.h"
+#include "image_store.h"
+#include "page_file.h"
+
+#define IMAGE_STORE_GENERATION_ATTR 'S'
+#define IMAGE_STORE_PAGE_SIZE 256
+
+static uint8_t store_data[IMAGE_STORE_SIZE];
+
+int image_store_generation(lfs_t *lfs, uint32_t *generation)
+{
+	int res = lfs_getattr(lfs, PAGE_SYS_DIR, IMAGE_STORE_GENERATION_ATTR,
+			generation, sizeof(*generation));
+	if (res == LFS_ERR_NOATTR) {
+		*generation = 0;
+		return 0;
+	} else if (res != sizeof(*generation)) {
+		return res < 0 ? res : LFS_ERR_CORRUPT;
+	}
+
+	return 0;
+}
+
+int image_store_begin(struct image_store *store, lfs_t *lfs)
+{
+	int res;
+
+	memset(store, 0, sizeof(*store));
+	store->lfs = lfs;
+
+	res = image_store_generation(lfs, &store->generation);
+	if (res) {
+		return res;
+	}
+
+	store->generation++;
+	if (store->generation == 0) {
+		store->generation++;
+	}
+
+	return lfs_setattr(lfs, PAGE_SYS_DIR, IMAGE_STORE_GENERATION_ATTR,
+			&store->generation, sizeof(store->generation));
+}
+
+int image_store_add(struct image_store *store, const uint8_t *data, uint32_t size, uint32_t *offset)
+{
+	uint32_t hash = fnv1a_update(FNV1A_INIT, data, size);
+
+	for (int i = 0; i < store->n_images; i++) {
+		if ((store->images[i].hash != hash) || (store->images[i].size != size)) {
+			continue;
+		}
+
+		// The hash only says it's probably the same
+		const uint8_t *stored = image_store_data(store->lfs, store->images[i].offset, size);
+		if (stored && (memcmp(stored, data, size) == 0)) {
+			*offset = store->images[i].offset;
+			return 0;
+		}
+	}
+
+	if ((store->n_images >= IMAGE_STORE_MAX_IMAGES) ||
+	    (size > IMAGE_STORE_SIZE - store->used)) {
+		return LFS_ERR_NOSPC;
+	}
+
+	memcpy(&store_data[store->used], data, size);
+
+	*offset = store->used;
+	store->images[store->n_images].hash = hash;
+	store->images[store->n_images].size = size;
+	store->images[store->n_images].offset = store->used;
+	store->n_images++;
+
+	store->used += (size + IMAGE_STORE_PAGE_SIZE - 1) & ~(IMAGE_STORE_PAGE_SIZE - 1);
+
+	return 0;
+}
+
+const uint8_t *image_store_data(lfs_t *lfs, uint32_t offset, uint32_t size)
+{
+	if ((offset > IMAGE_STORE_SIZE) || (size > IMAGE_STORE_SIZE - offset)) {
+		return NULL;
+	}
+
+	return &store_data[offset];
+}
@@ -0,0 +1,33 @@
+/*
+ * Stand-in for render_worker.c on the host: there's no second core, so both
+ * halves are drawn one after the other. That still runs the same split
+ * drawing code as the badge, so the output can be checked against drawing
+ * on one core.
+ */
+#include "badger.h"
+#include "render_worker.h"
+
+static bool running;
+
+void render_worker_start(void)
+{
+	running = true;
+}
+
+bool render_worker_running(void)
+{
+	return running;
+}
+
+bool render_worker_split(render_worker_fn fn, void *arg)
+{
+	int mid = BADGER_WIDTH / 2;
+
+	if (!running) {
+		return fn(arg, 0, BADGER_WIDTH);
+	}
+
+	bool res = fn(arg, mid, BADGER_WIDTH);
+
+	return fn(arg, 0, mid) && res;
+}
@@ -0,0 +1,150 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "hardware/flash.h"
+
+#include "littlefs/lfs.h"
+
+#include "hash.h"
+#include "image_store.h"
+#include "lfs_pico_flash.h"
+#include "page_file.h"
+
+// The generation is kept in littlefs, so that bumping it is atomic
+#define IMAGE_STORE_GENERATION_ATTR 'S'
+
+static uint32_t image_store_base(lfs_t *lfs)
+{
+	struct lfs_flash_cfg *ctx = lfs->cfg->context;
+
+	return ctx->base - IMAGE_STORE_SIZE;
+}
+
+// End of the firmware image in flash, from the linker script
+extern char __flash_binary_end;
+
+// The linker doesn't know about the store, so the firmware can grow into it.
+// Erasing it then would erase running code.
+static bool image_store_fits(lfs_t *lfs)
+{
+	return XIP_BASE + image_store_base(lfs) >= (uintptr_t)&__flash_binary_end;
+}
+
+int image_store_generation(lfs_t *lfs, uint32_t *generation)
+{
+	int res = lfs_getattr(lfs, PAGE_SYS_DIR, IMAGE_STORE_GENERATION_ATTR,
+			generation, sizeof(*generation));
+	if (res == LFS_ERR_NOATTR) {
+		*generation = 0;
+		return 0;
+	} else if (res != sizeof(*generation)) {
+		return res < 0 ? res : LFS_ERR_CORRUPT;
+	}
+
+	return 0;
+}
+
+int image_store_begin(struct image_store *store, lfs_t *lfs)
+{
+	int res;
+
+	memset(store, 0, sizeof(*store));
+	store->lfs = lfs;
+
+	if (!image_store_fits(lfs)) {
+		printf("firmware overlaps the image store\n");
+		return LFS_ERR_NOSPC;
+	}
+
+	res = image_store_generation(lfs, &store->generation);
+	if (res) {
+		return res;
+	}
+
+	// Generation 0 means "no store", so skip it on wrap-around
+	store->generation++;
+	if (store->generation == 0) {
+		store->generation++;
+	}
+
+	res = lfs_setattr(lfs, PAGE_SYS_DIR, IMAGE_STORE_GENERATION_ATTR,
+			&store->generation, sizeof(store->generation));
+	printf("image store generation %d: %d\n", store->generation, res);
+
+	return res;
+}
+
+int image_store_add(struct image_store *store, const uint8_t *data, uint32_t size, uint32_t *offset)
+{
+	struct lfs_flash_cfg *ctx = store->lfs->cfg->context;
+	uint32_t base = image_store_base(store->lfs);
+	uint32_t hash = fnv1a_update(FNV1A_INIT, data, size);
+
+	for (int i = 0; i < store->n_images; i++) {
+		if ((store->images[i].hash != hash) || (store->images[i].size != size)) {
+			continue;
+		}
+
+		// The hash only says it's probably the same
+		const uint8_t *stored = image_store_data(store->lfs, store->images[i].offset, size);
+		if (stored && (memcmp(stored, data, size) == 0)) {
+			*offset = store->images[i].offset;
+			return 0;
+		}
+	}
+
+	if ((store->n_images >= IMAGE_STORE_MAX_IMAGES) ||
+	    (size > IMAGE_STORE_SIZE - store->used)) {
+		return LFS_ERR_NOSPC;
+	}
+
+	// Erase as we go, so a sync only costs as many erases as it needs
+	uint32_t end = store->used + size;
+	if (end > store->erased) {
+		uint32_t len = ((end - store->erased) + FLASH_SECTOR_SIZE - 1) & ~(FLASH_SECTOR_SIZE - 1);
+		lfs_flash_range_erase(ctx, base + store->erased, len);
+		store->erased += len;
+	}
+
+	// Programming must be in whole pages
+	uint32_t done = 0;
+	while (done < size) {
+		uint8_t page[FLASH_PAGE_SIZE];
+		uint32_t len = size - done;
+
+		if (len > sizeof(page)) {
+			len = sizeof(page);
+		}
+
+		memset(page, 0xff, sizeof(page));
+		memcpy(page, data + done, len);
+
+		lfs_flash_range_program(ctx, base + store->used + done, page, sizeof(page));
+		done += len;
+	}
+
+	*offset = store->used;
+	store->images[store->n_images].hash = hash;
+	store->images[store->n_images].size = size;
+	store->images[store->n_images].offset = store->used;
+	store->n_images++;
+
+	store->used += (size + FLASH_PAGE_SIZE - 1) & ~(FLASH_PAGE_SIZE - 1);
+
+	return 0;
+}
+
+const uint8_t *image_store_data(lfs_t *lfs, uint32_t offset, uint32_t size)
+{
+	// Written by older, smaller firmware, and now it's code
+	if (!image_store_fits(lfs)) {
+		return NULL;
+	}
+
+	if ((offset > IMAGE_STORE_SIZE) || (size > IMAGE_STORE_SIZE - offset)) {
+		return NULL;
+	}
+
+	return (const uint8_t *)(XIP_BASE + image_store_base(lfs) + offset);
+}
@@ -0,0 +1,53 @@
+#ifndef __IMAGE_STORE_H__
+#define __IMAGE_STORE_H__
+
+#include <stdint.h>
+
+#include "littlefs/lfs.h"
+
+/*
+ * Image data doesn't have to live in littlefs, where it can be split across
+ * blocks. The image store is a plain flash region directly below the littlefs
+ * region, written during a USB sync, so that images can be drawn straight out
+ * of XIP flash without any allocation or copy.
+ *
+ * The store is rewritten from scratch on every sync, so each sync bumps the
+ * store generation, and compiled pages record the generation they refer to.
+ */
+#define IMAGE_STORE_SIZE (4096 * 16)
+#define IMAGE_STORE_MAX_IMAGES 16
+
+struct image_store {
+	lfs_t *lfs;
+	uint32_t generation;
+	// Bytes used, and bytes erased ready for use
+	uint32_t used;
+	uint32_t erased;
+
+	// Avoid storing the same image twice
+	int n_images;
+	struct {
+		uint32_t hash;
+		uint32_t size;
+		uint32_t offset;
+	} images[IMAGE_STORE_MAX_IMAGES];
+};
+
+// Start re-writing the store from the beginning. Invalidates everything
+// which was in the store before.
+// Returns LFS_ERR_NOSPC if the firmware has grown into the store, in which
+// case it can't be used at all.
+int image_store_begin(struct image_store *store, lfs_t *lfs);
+
+// Add 'size' bytes of image data to the store, returning the offset of the
+// data in the store in 'offset'
+int image_store_add(struct image_store *store, const uint8_t *data, uint32_t size, uint32_t *offset);
+
+// Get the current store generation
+int image_store_generation(lfs_t *lfs, uint32_t *generation);
+
+// Get an XIP pointer to 'size' bytes of image data at 'offset' in the store,
+// or NULL if it's out of range or the store can't be used
+const uint8_t *image_store_data(lfs_t *lfs, uint32_t offset, uint32_t size);
+
+#endif /* __IMAGE_STORE_H__ */
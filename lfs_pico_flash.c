@@ -21,18 +21,15 @@ int lfs_flash_read(const struct lfs_config *cfg, lfs_block_t block,
 	return 0;
 }
 
-int lfs_flash_prog(const struct lfs_config *cfg, lfs_block_t block,
-        lfs_off_t off, const void *buffer, lfs_size_t size)
+void lfs_flash_range_program(struct lfs_flash_cfg *ctx, uint32_t flash_offs,
+        const void *buffer, size_t size)
 {
-	struct lfs_flash_cfg *ctx = cfg->context;
-
 	if (ctx->multicore) {
 		multicore_lockout_start_blocking();
 	}
 
 	critical_section_enter_blocking(&ctx->lock);
 
-	uint32_t flash_offs = ctx->base + (block * cfg->block_size) + off;
 	flash_range_program(flash_offs, buffer, size);
 
 	critical_section_exit(&ctx->lock);
@@ -40,28 +37,42 @@ int lfs_flash_prog(const struct lfs_config *cfg, lfs_block_t block,
 	if (ctx->multicore) {
 		multicore_lockout_end_blocking();
 	}
-
-	return 0;
 }
 
-int lfs_flash_erase(const struct lfs_config *cfg, lfs_block_t block)
+void lfs_flash_range_erase(struct lfs_flash_cfg *ctx, uint32_t flash_offs, size_t size)
 {
-	struct lfs_flash_cfg *ctx = cfg->context;
-
 	if (ctx->multicore) {
 		multicore_lockout_start_blocking();
 	}
 
 	critical_section_enter_blocking(&ctx->lock);
 
-	uint32_t flash_offs = ctx->base + (block * cfg->block_size);
-	flash_range_erase(flash_offs, cfg->block_size);
+	flash_range_erase(flash_offs, size);
 
 	critical_section_exit(&ctx->lock);
 
 	if (ctx->multicore) {
 		multicore_lockout_end_blocking();
 	}
+}
+
+int lfs_flash_prog(const struct lfs_config *cfg, lfs_block_t block,
+        lfs_off_t off, const void *buffer, lfs_size_t size)
+{
+	struct lfs_flash_cfg *ctx = cfg->context;
+
+	uint32_t flash_offs = ctx->base + (block * cfg->block_size) + off;
+	lfs_flash_range_program(ctx, flash_offs, buffer, size);
+
+	return 0;
+}
+
+int lfs_flash_erase(const struct lfs_config *cfg, lfs_block_t block)
+{
+	struct lfs_flash_cfg *ctx = cfg->context;
+
+	uint32_t flash_offs = ctx->base + (block * cfg->block_size);
+	lfs_flash_range_erase(ctx, flash_offs, cfg->block_size);
 
 	return 0;
 }
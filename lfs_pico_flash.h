@@ -18,4 +18,9 @@ int lfs_flash_prog(const struct lfs_config *cfg, lfs_block_t block,
 int lfs_flash_erase(const struct lfs_config *cfg, lfs_block_t block);
 int lfs_flash_sync(const struct lfs_config *cfg);
 
+// Raw flash access, with the same locking as the littlefs callbacks
+void lfs_flash_range_program(struct lfs_flash_cfg *ctx, uint32_t flash_offs,
+        const void *buffer, size_t size);
+void lfs_flash_range_erase(struct lfs_flash_cfg *ctx, uint32_t flash_offs, size_t size);
+
 #endif /* __LFS_PICO_FLASH_H__ */
@@ -11,12 +11,24 @@
 #include "pico/multicore.h"
 
 #include "badger.h"
+#include "display_log.h"
+#include "fb_diff.h"
+#include "glyph_cache.h"
 #include "lfs_pico_flash.h"
+#include "page_file.h"
+#include "render_worker.h"
 #include "screen_page.h"
+#include "status.h"
 #include "usb.h"
 
 #define README_CONTENTS "This is the default file"
 
+// On battery, draw pages on both cores
+#define RENDER_ON_BOTH_CORES 1
+
+// Append display refresh timings to a log in flash at each power-off
+#define LOG_DISPLAY_TIMINGS 1
+
 extern void prepare_usb_filesystem(lfs_t *lfs, struct usb_msc_disk *msc_disk);
 extern int do_flash_update(lfs_t *lfs);
 
@@ -33,6 +45,8 @@ enum msg_type {
 	MSG_TYPE_CDC_CONNECTED,
 	MSG_TYPE_POWER_OFF,
 	MSG_TYPE_BTNS_CHANGED,
+	MSG_TYPE_DISPLAY_DONE,
+	MSG_TYPE_STATUS_SETTLED,
 };
 
 struct msg {
@@ -130,6 +144,25 @@ static void power_ref_put()
 	}
 }
 
+// Status messages tend to arrive in bursts, so wait for them to settle and
+// show them all with one update
+static alarm_id_t status_alarm;
+#define STATUS_SETTLE_MS 300
+static int64_t status_settled(alarm_id_t id, void *d)
+{
+	queue_try_add(&msg_queue, &(struct msg){ .type = MSG_TYPE_STATUS_SETTLED });
+
+	return 0;
+}
+
+static void status_show(int y, const char *msg)
+{
+	status_set(y, msg);
+
+	cancel_alarm(status_alarm);
+	status_alarm = add_alarm_in_ms(STATUS_SETTLE_MS, status_settled, NULL, true);
+}
+
 enum lfs_state {
 	LFS_STATE_ERROR = -1,
 	LFS_STATE_NONE = 0,
@@ -251,203 +284,224 @@ int lfs_ctx_unmount(struct lfs_ctx *ctx)
 	return 0;
 }
 
-char *read_file(lfs_t *lfs, const char *path)
-{
-	struct lfs_info st;
-	lfs_file_t fp;
+// The list of pages and the glyph cache written at sync time, loaded on first use
+static struct {
+	bool loaded;
 	int res;
-	char *buf;
-
-	res = lfs_stat(lfs, path, &st);
-	if (res != 0) {
-		return NULL;
-	}
-
-	printf("stat %s: %d\n", path, st.size);
+	struct page_manifest manifest;
+} pages;
 
-	buf = malloc(st.size);
+static void pages_invalidate(void)
+{
+	pages.loaded = false;
+}
 
-	res = lfs_file_open(lfs, &fp, path, LFS_O_RDONLY);
-	if (res) {
-		free(buf);
-		return NULL;
+static void pages_load(lfs_t *lfs)
+{
+	if (pages.loaded) {
+		return;
 	}
 
-	res = lfs_file_read(lfs, &fp, buf, st.size);
-	lfs_file_close(lfs, &fp);
-	if (res != st.size) {
-		free(buf);
-		return NULL;
+	pages.res = page_manifest_load(lfs, &pages.manifest);
+	if (pages.res) {
+		printf("no page manifest: %d\n", pages.res);
 	}
 
-	return buf;
+	// Glyphs which aren't cached just get stroked
+	int res = glyph_cache_load(lfs, GLYPH_CACHE_PATH);
+	if (res) {
+		printf("no glyph cache: %d\n", res);
+	}
+	pages.loaded = true;
 }
 
-int parse_img(lfs_t *lfs, struct screen_page_item *item, char *buf)
+// Whether page 'idx' is 'name', as load_page_idx() would find it
+static bool page_idx_is(lfs_t *lfs, int idx, const char *name)
 {
-	char *tok, *tmp;
-
-	item->type = PAGE_ITEM_TYPE_IMAGE;
-
-	// img
-	tok = strsep(&buf, " ");
-	printf("first tok: %s\n", tok);
-	tmp = index(tok, '.');
-	if (tmp) {
-		printf("font: %s\n", tmp);
-	}
+	char path[64];
 
-	tok = strsep(&buf, " ");
-	printf("width tok: %s\n", tok);
-	if (sscanf(tok, "%d", &item->image.width) != 1) {
-		printf("failed parsing img.width\n");
-		return -1;
-	}
+	pages_load(lfs);
 
-	tok = strsep(&buf, " ");
-	printf("height tok: %s\n", tok);
-	if (sscanf(tok, "%d", &item->image.height) != 1) {
-		printf("failed parsing image.height\n");
-		return -1;
+	if (!pages.res) {
+		return (idx >= 0) && (idx < pages.manifest.n_pages) &&
+			(strcmp(page_manifest_path(&pages.manifest, idx), name) == 0);
 	}
 
-	tok = strsep(&buf, " ");
-	printf("path tok: %s\n", tok);
-	item->image.data = (uint8_t *)read_file(lfs, tok);
-	if (!item->image.data) {
-		printf("failed reading image.data\n");
-		return -1;
+	if (idx > 0) {
+		snprintf(path, sizeof(path), "page%d.txt", idx);
+	} else {
+		snprintf(path, sizeof(path), "main.txt");
 	}
 
-	printf("Parsed image: %d %d '%08x'\n",
-			item->image.width, item->image.height, *(uint32_t *)item->image.data);
-
-	return 0;
+	return strcmp(path, name) == 0;
 }
 
-int parse_text(lfs_t *lfs, struct screen_page_item *item, char *buf)
+// Load page 'idx' from the manifest (or probe for pageN.txt if there isn't one),
+// wrapping around to main.txt if it doesn't exist
+static struct screen_page *load_page_idx(lfs_t *lfs, int *idx, char *path, size_t len)
 {
-	char *tok, *tmp;
+	struct screen_page *page = NULL;
 
-	item->type = PAGE_ITEM_TYPE_TEXT;
+	pages_load(lfs);
 
-	// text.font
-	tok = strsep(&buf, " ");
-	printf("first tok: %s\n", tok);
-	tmp = index(tok, '.');
-	if (tmp) {
-		printf("font: %s\n", tmp);
-	}
+	if (!pages.res) {
+		// Only pages which compiled are in the manifest, so don't go
+		// looking for anything else
+		if (!pages.manifest.n_pages) {
+			*idx = 0;
+			return NULL;
+		}
 
-	tok = strsep(&buf, " ");
-	printf("size tok: %s\n", tok);
-	if (sscanf(tok, "%f", &item->text.size) != 1) {
-		printf("failed parsing text.size\n");
-		return -1;
+		*idx %= pages.manifest.n_pages;
+		snprintf(path, len, "%s", page_manifest_path(&pages.manifest, *idx));
+		page = page_load(lfs, path);
+		if (!page && *idx) {
+			*idx = 0;
+			snprintf(path, len, "%s", page_manifest_path(&pages.manifest, *idx));
+			page = page_load(lfs, path);
+		}
+
+		return page;
 	}
 
-	tok = strsep(&buf, " ");
-	printf("color tok: %s\n", tok);
-	if (sscanf(tok, "%hhd", &item->text.color) != 1) {
-		printf("failed parsing text.color\n");
-		return -1;
+	if (*idx) {
+		// No manifest, so probe for the page
+		snprintf(path, len, "page%d.txt", *idx);
+		page = page_load(lfs, path);
 	}
 
-	tok = strsep(&buf, " ");
-	printf("thickness tok: %s\n", tok);
-	if (sscanf(tok, "%hhd", &item->text.thickness) != 1) {
-		printf("failed parsing text.thickness\n");
-		return -1;
+	if (!page) {
+		*idx = 0;
+		snprintf(path, len, "main.txt");
+		page = page_load(lfs, path);
 	}
 
-	tok = strsep(&buf, "\n");
-	printf("text tok: %s\n", tok);
-	item->text.text = malloc(strlen(tok) + 1);
-	strcpy(item->text.text, tok);
+	return page;
+}
 
-	printf("Parsed text: %1.3f %d %d '%s'\n",
-			item->text.size, item->text.color, item->text.thickness, item->text.text);
+// The page which will probably be shown next, loaded while the display is busy
+static struct {
+	struct screen_page *page;
+	// Index of the page which was showing when this was prefetched
+	int prev_idx;
+	int idx;
+	char path[64];
+} prefetch;
 
-	return 0;
+static void prefetch_drop(void)
+{
+	screen_page_free(prefetch.page);
+	prefetch.page = NULL;
 }
 
-void screen_page_free(struct screen_page *page)
+static void prefetch_next(struct lfs_ctx *ctx, bool multicore, int current_idx)
 {
-	if (!page) {
+	prefetch_drop();
+
+	if (lfs_ctx_mount(ctx, multicore)) {
 		return;
 	}
 
-	for (int i = 0; i < page->n_items; i++) {
-		struct screen_page_item *item = &page->items[i];
-		switch (item->type) {
-		case PAGE_ITEM_TYPE_IMAGE:
-			free(item->image.data);
-			break;
-		case PAGE_ITEM_TYPE_TEXT:
-			free(item->text.text);
-			break;
-		}
-	}
+	prefetch.prev_idx = current_idx;
+	prefetch.idx = current_idx + 1;
+	prefetch.page = load_page_idx(&ctx->lfs, &prefetch.idx, prefetch.path, sizeof(prefetch.path));
 
-	free(page);
+	lfs_ctx_unmount(ctx);
 }
 
-struct screen_page *parse_file(lfs_t *lfs, const char *path)
+// Returns the prefetched page, if it's the one after 'current_idx'
+static struct screen_page *prefetch_take(int current_idx, int *idx, char *path, size_t len)
 {
-	int res;
-	struct screen_page *page = NULL;
+	struct screen_page *page = prefetch.page;
 
-	char *buf = read_file(lfs, path);
-	if (!buf) {
+	if (!page || (prefetch.prev_idx != current_idx)) {
+		prefetch_drop();
 		return NULL;
 	}
 
-	int nlines = 0;
-	char *p = buf;
-	while (*p) {
-		if (*p == '\n') {
-			nlines++;
-		}
-		p++;
+	*idx = prefetch.idx;
+	snprintf(path, len, "%s", prefetch.path);
+	prefetch.page = NULL;
+
+	return page;
+}
+
+/*
+ * What was left on the display at power-off. The panel keeps its image with
+ * the power off, so this lets the next wake carry on from the same page, and
+ * skip refreshing whatever is already on the panel.
+ *
+ * It's kept in flash because nothing else survives the 3V3 rail being cut.
+ */
+#define DISPLAY_STATE_ATTR    'D'
+#define DISPLAY_STATE_VERSION 1
+
+struct display_state {
+	uint16_t version;
+	int16_t page_idx;
+	char page[64];
+	struct fb_fingerprint fingerprint;
+};
+
+// The last state loaded or saved
+static struct display_state display_state;
+
+static void display_state_restore(lfs_t *lfs, int *idx, char *path, size_t len)
+{
+	lfs_ssize_t res = lfs_getattr(lfs, PAGE_SYS_DIR, DISPLAY_STATE_ATTR,
+			&display_state, sizeof(display_state));
+	if ((res != sizeof(display_state)) || (display_state.version != DISPLAY_STATE_VERSION)) {
+		printf("no display state: %d\n", res);
+		memset(&display_state, 0, sizeof(display_state));
+		return;
 	}
-	printf("nlines: %d\n", nlines);
 
-	page = calloc(1, sizeof(*page));
-	page->items = calloc(nlines, sizeof(*page->items));
+	display_state.page[sizeof(display_state.page) - 1] = '\0';
 
-	char *next = buf, *line;
-	while (next) {
-		line = strsep(&next, "\n");
-		printf("item: %d, %s\n", page->n_items, line);
+	// Whatever page it was, it's still what's on the panel
+	badger_set_fingerprint(&display_state.fingerprint);
 
-		if (strncmp(line, "text", strlen("text")) == 0) {
-			res = parse_text(lfs, &page->items[page->n_items], line);
-		} else if (strncmp(line, "img", strlen("img")) == 0) {
-			res = parse_img(lfs, &page->items[page->n_items], line);
-		} else {
-			printf("skip unknown type: '%s'\n", line);
-			continue;
-		}
+	// A sync can add, remove or reorder pages, so only go back to the
+	// index if it's still the same page
+	if (!page_idx_is(lfs, display_state.page_idx, display_state.page)) {
+		printf("page %d isn't %s any more\n", display_state.page_idx, display_state.page);
+		return;
+	}
 
-		if (res) {
-			break;
-		}
+	*idx = display_state.page_idx;
+	snprintf(path, len, "%s", display_state.page);
+}
 
-		page_item_calculate_size(&page->items[page->n_items]);
+static void display_state_save(struct lfs_ctx *ctx, bool multicore, int idx, const char *path)
+{
+	struct display_state state;
+	int res;
 
-		page->n_items++;
+	memset(&state, 0, sizeof(state));
+	state.version = DISPLAY_STATE_VERSION;
+	state.page_idx = idx;
+	snprintf(state.page, sizeof(state.page), "%s", path);
+
+	if (!badger_get_fingerprint(&state.fingerprint)) {
+		return;
 	}
 
-	free(buf);
+	// Don't wear out the flash if nothing changed
+	if (memcmp(&state, &display_state, sizeof(state)) == 0) {
+		return;
+	}
 
-	printf("res: %d, n_items: %d\n", res, page->n_items);
+	if (lfs_ctx_mount(ctx, multicore)) {
+		return;
+	}
 
-	if (res) {
-		screen_page_free(page);
-		page = NULL;
+	res = lfs_setattr(&ctx->lfs, PAGE_SYS_DIR, DISPLAY_STATE_ATTR, &state, sizeof(state));
+	printf("save display state: %d\n", res);
+	if (!res) {
+		display_state = state;
 	}
 
-	return page;
+	lfs_ctx_unmount(ctx);
 }
 
 static int64_t button_changed(alarm_id_t id, void *d)
@@ -462,6 +516,12 @@ static void gpio_irq_cb(uint gpio, uint32_t events)
 {
 	static uint32_t ts = 0;
 
+	// The panel has finished refreshing
+	if (gpio == BADGER_PIN_BUSY) {
+		queue_try_add(&msg_queue, &(struct msg){ .type = MSG_TYPE_DISPLAY_DONE });
+		return;
+	}
+
 	uint32_t now = time_us_32();
 	int32_t diff = now - ts;
 	ts = now;
@@ -478,7 +538,7 @@ int main() {
 			{
 				.type = PAGE_ITEM_TYPE_TEXT,
 				.text = {
-					.size = 1.0,
+					.size = BADGER_FIXED(1.0f),
 					.color = 0,
 					.thickness = 4,
 					.text = "Error!",
@@ -487,7 +547,7 @@ int main() {
 			{
 				.type = PAGE_ITEM_TYPE_TEXT,
 				.text = {
-					.size = 0.8,
+					.size = BADGER_FIXED(0.8f),
 					.color = 3,
 					.thickness = 2,
 					.text = "No main.txt content?",
@@ -515,7 +575,9 @@ int main() {
 			.block_cycles = 500,
 		},
 		.priv = {
-			// FIXME: The linker doesn't know anything about this
+			// FIXME: The linker doesn't know anything about this, or the
+			// image store which sits directly below it. The store checks
+			// that the firmware hasn't grown into it, littlefs doesn't.
 			.base = PICO_FLASH_SIZE_BYTES - (4096 * 16),
 		},
 		.state = LFS_STATE_NONE,
@@ -550,6 +612,7 @@ int main() {
 	gpio_set_irq_enabled(BADGER_PIN_D, GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL, true);
 	gpio_set_irq_enabled(BADGER_PIN_UP, GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL, true);
 	gpio_set_irq_enabled(BADGER_PIN_DOWN, GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL, true);
+	gpio_set_irq_enabled(BADGER_PIN_BUSY, GPIO_IRQ_EDGE_RISE, true);
 
 
 	queue_init(&msg_queue, sizeof(struct msg), 8);
@@ -572,15 +635,21 @@ int main() {
 		launch_usb();
 	} else {
 		usb_state = USB_STATE_UNMOUNTED;
+
+#if RENDER_ON_BOTH_CORES
+		// Same as for USB, core1 has to be locked out for flash writes
+		lfs_ctx_unmount(&lfs_ctx);
+		render_worker_start();
+		multicore = true;
+#endif
 	}
 
 	// TODO: Always?
 	badger_pen(15);
 	badger_clear();
 	badger_pen(0);
-	badger_update_speed(2);
 	/*
-	badger_update(true);
+	badger_present();
 	*/
 
 	// Boot-up done
@@ -593,6 +662,7 @@ int main() {
 
 	int current_idx = 0;
 	char current_page[64] = "main.txt";
+	bool display_state_restored = false;
 
 	for ( ;; ) {
 		struct msg msg;
@@ -616,25 +686,13 @@ int main() {
 				break;
 			case MSG_TYPE_USB_CONNECTED:
 				// Show USB screen
-				badger_update_speed(2);
-				badger_pen(15);
-				badger_rectangle(0, 16, BADGER_WIDTH, 16);
-				badger_pen(0);
-				badger_thickness(1);
-				badger_text("USB connected. Eject and press A to update", 10, 24, 0.4f, 0.0f, 1);
-				badger_partial_update(0, 16, 296, 16, true);
+				status_show(16, "USB connected. Eject and press A to update");
 
 				usb_state = USB_STATE_MOUNTED;
 				power_ref_get();
 				break;
 			case MSG_TYPE_USB_DISCONNECTED:
-				badger_update_speed(2);
-				badger_pen(15);
-				badger_rectangle(0, 24, BADGER_WIDTH, 16);
-				badger_pen(0);
-				badger_thickness(1);
-				badger_text("USB disconnected", 10, 32, 0.4f, 0.0f, 1);
-				badger_partial_update(0, 24, 296, 16, true);
+				status_show(24, "USB disconnected");
 
 				usb_state = USB_STATE_UNMOUNTED;
 
@@ -642,26 +700,23 @@ int main() {
 				if (!res) {
 					// TODO: To be totally safe, should also take away the MSC disk here
 					// in case of reconnect before the update is finished
-					badger_update_speed(2);
-					badger_pen(15);
-					badger_rectangle(0, 40, BADGER_WIDTH, 16);
-					badger_pen(0);
-					badger_thickness(1);
-
+					prefetch_drop();
 					res = do_flash_update(&lfs_ctx.lfs);
+					pages_invalidate();
+					// Start from main.txt, not the page from before the update
+					display_state_restored = true;
 					if (res) {
 						printf("failed to update flash");
-						badger_text("failed to update flash", 10, 48, 0.4f, 0.0f, 1);
-						badger_partial_update(0, 40, 296, 16, true);
+						status_show(40, "failed to update flash");
 					} else {
-						badger_text("flash updated", 10, 48, 0.4f, 0.0f, 1);
-						badger_partial_update(0, 40, 296, 16, true);
+						status_show(40, "flash updated");
 					}
 
 					lfs_ctx_unmount(&lfs_ctx);
 				}
 
 				// Show main screen
+				current_idx = 0;
 				refresh = true;
 
 				power_ref_put();
@@ -675,16 +730,13 @@ int main() {
 				res = lfs_ctx_mount(&lfs_ctx, multicore);
 				printf("mount: %d\n", res);
 				if (!res) {
-					struct screen_page *page = parse_file(&lfs_ctx.lfs, current_page);
-					if (!page) {
-						sprintf(current_page, "main.txt");
-						current_idx = 0;
-						page = parse_file(&lfs_ctx.lfs, current_page);
-					}
+					struct screen_page *page = load_page_idx(&lfs_ctx.lfs, &current_idx,
+							current_page, sizeof(current_page));
 					lfs_ctx_unmount(&lfs_ctx);
 
 					if (page) {
-						badger_update_speed(0);
+						// It has to last until the next power-on
+						badger_refresh_clean();
 						screen_page_display(page);
 						screen_page_free(page);
 					}
@@ -692,12 +744,28 @@ int main() {
 
 				badger_pen(0);
 				badger_thickness(1);
-				badger_update_speed(3);
-				badger_text("o", 2, 4, 0.4f, 0.0f, 1);
-				badger_partial_update(0, 0, 16, 16, true);
+				badger_text("o", 2, 4, BADGER_FIXED(0.4f), 0, 1);
+				badger_present_region(0, 0, 16, 16);
 
 				lfs_ctx_unmount(&lfs_ctx);
 
+				display_state_save(&lfs_ctx, multicore, current_idx, current_page);
+
+				// The refresh carries on while the state is saved, but
+				// has to finish before the power goes
+				badger_fence();
+
+#if LOG_DISPLAY_TIMINGS
+				// Only now has the last refresh been timed
+				if (!lfs_ctx_mount(&lfs_ctx, multicore)) {
+					res = display_log_flush(&lfs_ctx.lfs);
+					if (res) {
+						printf("display log flush failed: %d\n", res);
+					}
+					lfs_ctx_unmount(&lfs_ctx);
+				}
+#endif
+
 				gpio_put(BADGER_PIN_ENABLE_3V3, 0);
 
 				// If we're on VBUS, then actually we keep running
@@ -709,7 +777,9 @@ int main() {
 				res = lfs_ctx_mount(&lfs_ctx, multicore);
 				printf("mount: %d\n", res);
 				if (!res) {
-					struct screen_page *page = parse_file(&lfs_ctx.lfs, "barcode.txt");
+					display_log_dump(&lfs_ctx.lfs);
+
+					struct screen_page *page = page_load(&lfs_ctx.lfs, "barcode.txt");
 					lfs_ctx_unmount(&lfs_ctx);
 
 					if (page) {
@@ -718,6 +788,17 @@ int main() {
 					}
 				}
 
+				break;
+			case MSG_TYPE_DISPLAY_DONE:
+				badger_display_done();
+				break;
+			case MSG_TYPE_STATUS_SETTLED:
+				// A page about to be displayed will show them anyway. The
+				// refresh only happens once USB isn't mounted, so while it
+				// is they have to go out on their own.
+				if (!refresh || (usb_state != USB_STATE_UNMOUNTED)) {
+					status_flush();
+				}
 				break;
 			case MSG_TYPE_BTNS_CHANGED:
 				{
@@ -729,24 +810,27 @@ int main() {
 					buttons = new;
 
 					if (released & (1 << BADGER_PIN_DOWN)) {
-						current_idx++;
-						sprintf(current_page, "page%d.txt", current_idx);
-						res = lfs_ctx_mount(&lfs_ctx, multicore);
-						printf("mount: %d\n", res);
-						if (!res) {
-							struct screen_page *page = parse_file(&lfs_ctx.lfs, current_page);
-							if (!page) {
-								sprintf(current_page, "main.txt");
-								current_idx = 0;
-								page = parse_file(&lfs_ctx.lfs, current_page);
+						struct screen_page *page = prefetch_take(current_idx, &current_idx,
+								current_page, sizeof(current_page));
+						if (!page) {
+							res = lfs_ctx_mount(&lfs_ctx, multicore);
+							printf("mount: %d\n", res);
+							if (!res) {
+								current_idx++;
+								page = load_page_idx(&lfs_ctx.lfs, &current_idx,
+										current_page, sizeof(current_page));
+								lfs_ctx_unmount(&lfs_ctx);
 							}
-							lfs_ctx_unmount(&lfs_ctx);
+						}
 
-							if (page) {
-								badger_update_speed(3);
-								screen_page_display(page);
-								screen_page_free(page);
-							}
+						if (page) {
+							screen_page_display(page);
+							screen_page_free(page);
+
+							// Get the next page ready while the display
+							// refreshes. Presenting it will wait for the
+							// refresh, so there's no need to here.
+							prefetch_next(&lfs_ctx, multicore, current_idx);
 						}
 					}
 
@@ -754,13 +838,7 @@ int main() {
 						tud_disconnect();
 
 						// HAX! This is just a copy of the full disconnect handler
-						badger_update_speed(2);
-						badger_pen(15);
-						badger_rectangle(0, 24, BADGER_WIDTH, 16);
-						badger_pen(0);
-						badger_thickness(1);
-						badger_text("USB disconnected", 10, 32, 0.4f, 0.0f, 1);
-						badger_partial_update(0, 24, 296, 16, true);
+						status_show(24, "USB disconnected");
 
 						usb_state = USB_STATE_UNMOUNTED;
 
@@ -768,20 +846,16 @@ int main() {
 						if (!res) {
 							// TODO: To be totally safe, should also take away the MSC disk here
 							// in case of reconnect before the update is finished
-							badger_update_speed(2);
-							badger_pen(15);
-							badger_rectangle(0, 40, BADGER_WIDTH, 16);
-							badger_pen(0);
-							badger_thickness(1);
-
+							prefetch_drop();
 							res = do_flash_update(&lfs_ctx.lfs);
+							pages_invalidate();
+							// Start from main.txt, not the page from before the update
+							display_state_restored = true;
 							if (res) {
 								printf("failed to update flash");
-								badger_text("failed to update flash", 10, 48, 0.4f, 0.0f, 1);
-								badger_partial_update(0, 40, 296, 16, true);
+								status_show(40, "failed to update flash");
 							} else {
-								badger_text("flash updated", 10, 48, 0.4f, 0.0f, 1);
-								badger_partial_update(0, 40, 296, 16, true);
+								status_show(40, "flash updated");
 							}
 
 							lfs_ctx_unmount(&lfs_ctx);
@@ -815,12 +889,22 @@ int main() {
 				res = lfs_ctx_mount(&lfs_ctx, multicore);
 				printf("mount: %d\n", res);
 				if (!res) {
-					struct screen_page *page = parse_file(&lfs_ctx.lfs, "main.txt");
+					if (!display_state_restored) {
+						// Pick up where the last power-off left the display
+						display_state_restore(&lfs_ctx.lfs, &current_idx,
+								current_page, sizeof(current_page));
+						display_state_restored = true;
+					}
+
+					struct screen_page *page = load_page_idx(&lfs_ctx.lfs, &current_idx,
+							current_page, sizeof(current_page));
 					lfs_ctx_unmount(&lfs_ctx);
 
 					if (page) {
 						screen_page_display(page);
 						screen_page_free(page);
+
+						prefetch_next(&lfs_ctx, multicore, current_idx);
 					} else {
 						screen_page_calculate_sizes(&empty_page);
 						screen_page_display(&empty_page);
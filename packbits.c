@@ -0,0 +1,107 @@
+#include <string.h>
+
+#include "packbits.h"
+
+#define PACKBITS_MAX_PACKET 128
+
+uint32_t packbits_encode(const uint8_t *src, uint32_t size, uint8_t *dst, uint32_t dst_size)
+{
+	uint32_t i = 0, o = 0;
+
+	while (i < size) {
+		uint32_t run = 1;
+
+		while ((i + run < size) && (run < PACKBITS_MAX_PACKET) && (src[i + run] == src[i])) {
+			run++;
+		}
+
+		// A run of 2 is no smaller than a literal, and would split one
+		if (run >= 3) {
+			if (o + 2 > dst_size) {
+				return 0;
+			}
+
+			dst[o++] = (uint8_t)(1 - (int)run);
+			dst[o++] = src[i];
+			i += run;
+			continue;
+		}
+
+		// Literal, up to the next run worth encoding
+		uint32_t start = i, n = 0;
+		while ((i < size) && (n < PACKBITS_MAX_PACKET)) {
+			if ((i + 2 < size) && (src[i] == src[i + 1]) && (src[i] == src[i + 2])) {
+				break;
+			}
+			i++;
+			n++;
+		}
+
+		if (o + 1 + n > dst_size) {
+			return 0;
+		}
+
+		dst[o++] = n - 1;
+		memcpy(&dst[o], &src[start], n);
+		o += n;
+	}
+
+	return o;
+}
+
+void packbits_reader_init(struct packbits_reader *r, const uint8_t *data, uint32_t size)
+{
+	r->p = data;
+	r->end = data + size;
+	r->count = 0;
+	r->repeat = false;
+}
+
+int packbits_read(struct packbits_reader *r, uint8_t *dst, uint32_t n)
+{
+	while (n) {
+		if (!r->count) {
+			if (r->p >= r->end) {
+				return -1;
+			}
+
+			int8_t hdr = (int8_t)*r->p++;
+			if (hdr == -128) {
+				continue;
+			} else if (hdr >= 0) {
+				r->count = hdr + 1;
+				r->repeat = false;
+			} else {
+				r->count = 1 - hdr;
+				r->repeat = true;
+			}
+		}
+
+		uint32_t chunk = r->count < n ? r->count : n;
+
+		if (r->repeat) {
+			if (r->p >= r->end) {
+				return -1;
+			}
+
+			memset(dst, *r->p, chunk);
+			r->count -= chunk;
+			if (!r->count) {
+				r->p++;
+			}
+		} else {
+			if ((uint32_t)(r->end - r->p) < chunk) {
+				return -1;
+			}
+
+			memcpy(dst, r->p, chunk);
+			r->p += chunk;
+			r->count -= chunk;
+		}
+
+		dst += chunk;
+		n -= chunk;
+	}
+
+	return 0;
+}
@@ -0,0 +1,33 @@
+#ifndef __PACKBITS_H__
+#define __PACKBITS_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * PackBits run-length encoding, which suits 1bpp art with large areas of
+ * solid colour. Each packet starts with a header byte 'n':
+ *   0 to 127:    n + 1 literal bytes follow
+ *   -1 to -127:  the next byte is repeated 1 - n times
+ *   -128:        no-op
+ */
+
+// Returns the encoded size, or 0 if it would be bigger than 'dst_size'
+uint32_t packbits_encode(const uint8_t *src, uint32_t size, uint8_t *dst, uint32_t dst_size);
+
+// Decodes a piece at a time, so that images can be drawn without decoding
+// the whole thing anywhere
+struct packbits_reader {
+	const uint8_t *p, *end;
+	// What's left of the current packet
+	uint32_t count;
+	bool repeat;
+};
+
+void packbits_reader_init(struct packbits_reader *r, const uint8_t *data, uint32_t size);
+
+// Decode the next 'n' bytes into 'dst'. Returns 0, or -1 if the data is
+// truncated.
+int packbits_read(struct packbits_reader *r, uint8_t *dst, uint32_t n);
+
+#endif /* __PACKBITS_H__ */
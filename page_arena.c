@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "page_arena.h"
+
+#define ARENA_ALIGN 8
+#define ALIGN_UP(_x, _a) (((_x) + ((_a) - 1)) & ~((_a) - 1))
+
+// Bottom allocations are prefixed with their size, so that they can be resized
+struct arena_hdr {
+	uint32_t size;
+	uint32_t reserved;
+};
+
+static uint8_t arena_bufs[PAGE_ARENA_COUNT][PAGE_ARENA_SIZE] __attribute__((aligned(ARENA_ALIGN)));
+static struct page_arena arenas[PAGE_ARENA_COUNT];
+
+static void page_arena_reset(struct page_arena *arena)
+{
+	arena->head = 0;
+	arena->tail = arena->size;
+}
+
+static void page_arena_update_peak(struct page_arena *arena)
+{
+	size_t used = arena->head + (arena->size - arena->tail);
+
+	if (used > arena->peak) {
+		arena->peak = used;
+	}
+}
+
+struct page_arena *page_arena_get(void)
+{
+	for (int i = 0; i < PAGE_ARENA_COUNT; i++) {
+		struct page_arena *arena = &arenas[i];
+
+		if (!arena->in_use) {
+			arena->buf = arena_bufs[i];
+			arena->size = PAGE_ARENA_SIZE;
+			arena->in_use = true;
+			page_arena_reset(arena);
+			return arena;
+		}
+	}
+
+	printf("no free page arena\n");
+
+	return NULL;
+}
+
+void page_arena_put(struct page_arena *arena)
+{
+	if (!arena) {
+		return;
+	}
+
+	page_arena_reset(arena);
+	arena->in_use = false;
+}
+
+void *page_arena_alloc(struct page_arena *arena, size_t size)
+{
+	size_t need = sizeof(struct arena_hdr) + ALIGN_UP(size, ARENA_ALIGN);
+
+	if (need > arena->tail - arena->head) {
+		printf("page arena full: %zu\n", size);
+		return NULL;
+	}
+
+	struct arena_hdr *hdr = (struct arena_hdr *)&arena->buf[arena->head];
+	hdr->size = size;
+	arena->head += need;
+	page_arena_update_peak(arena);
+
+	return hdr + 1;
+}
+
+void *page_arena_alloc_top(struct page_arena *arena, size_t size)
+{
+	size_t need = ALIGN_UP(size, ARENA_ALIGN);
+
+	if (need > arena->tail - arena->head) {
+		printf("page arena full: %zu\n", size);
+		return NULL;
+	}
+
+	arena->tail -= need;
+	page_arena_update_peak(arena);
+
+	return &arena->buf[arena->tail];
+}
+
+static bool page_arena_is_last(struct page_arena *arena, void *ptr)
+{
+	struct arena_hdr *hdr = (struct arena_hdr *)ptr - 1;
+
+	return (uint8_t *)ptr + ALIGN_UP(hdr->size, ARENA_ALIGN) == &arena->buf[arena->head];
+}
+
+void *page_arena_realloc(struct page_arena *arena, void *ptr, size_t size)
+{
+	if (!ptr) {
+		return page_arena_alloc(arena, size);
+	}
+
+	struct arena_hdr *hdr = (struct arena_hdr *)ptr - 1;
+	size_t start = (uint8_t *)ptr - arena->buf;
+
+	if (page_arena_is_last(arena, ptr)) {
+		size_t end = start + ALIGN_UP(size, ARENA_ALIGN);
+		if (end > arena->tail) {
+			printf("page arena full: %zu\n", size);
+			return NULL;
+		}
+
+		hdr->size = size;
+		arena->head = end;
+		page_arena_update_peak(arena);
+
+		return ptr;
+	}
+
+	void *new = page_arena_alloc(arena, size);
+	if (new) {
+		memcpy(new, ptr, hdr->size < size ? hdr->size : size);
+	}
+
+	return new;
+}
+
+void page_arena_free(struct page_arena *arena, void *ptr)
+{
+	// Only the most recent bottom allocation can be given back, anything
+	// else goes when the whole arena is released
+	if (ptr && page_arena_is_last(arena, ptr)) {
+		arena->head = (uint8_t *)ptr - sizeof(struct arena_hdr) - arena->buf;
+	}
+}
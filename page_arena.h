@@ -0,0 +1,43 @@
+#ifndef __PAGE_ARENA_H__
+#define __PAGE_ARENA_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Everything belonging to a screen_page is allocated from a fixed-size arena,
+ * which is released in one go when the page is freed.
+ *
+ * Allocations which may need to grow (the items array, the layout context)
+ * come from the bottom of the arena, and can be resized in place if they are
+ * the most recent bottom allocation. Everything else comes from the top.
+ *
+ * There's one arena for the page being displayed and one for a prefetched
+ * page.
+ */
+#define PAGE_ARENA_SIZE  (12 * 1024)
+#define PAGE_ARENA_COUNT 2
+
+struct page_arena {
+	uint8_t *buf;
+	size_t size;
+	size_t head;
+	size_t tail;
+	// High water mark
+	size_t peak;
+	bool in_use;
+};
+
+// Get a free arena from the pool, or NULL if they're all in use
+struct page_arena *page_arena_get(void);
+
+// Release everything allocated from 'arena', and return it to the pool
+void page_arena_put(struct page_arena *arena);
+
+void *page_arena_alloc(struct page_arena *arena, size_t size);
+void *page_arena_alloc_top(struct page_arena *arena, size_t size);
+void *page_arena_realloc(struct page_arena *arena, void *ptr, size_t size);
+void page_arena_free(struct page_arena *arena, void *ptr);
+
+#endif /* __PAGE_ARENA_H__ */
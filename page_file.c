@@ -0,0 +1,1207 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "littlefs/lfs.h"
+
+#include "badger.h"
+#include "glyph_cache.h"
+#include "hash.h"
+#include "image_store.h"
+#include "page_arena.h"
+#include "packbits.h"
+#include "page_file.h"
+#include "pnm.h"
+#include "screen_page.h"
+
+/*
+ * Compiled page format
+ *
+ * The text pages are the authoring format, but tokenising them and measuring
+ * all the text is too slow to do on every wake. During a USB sync each page is
+ * compiled into a flat binary which can be loaded with a single read:
+ *
+ *   struct page_bin_header
+ *   struct page_bin_item[n_items]
+ *   payloads (NUL-terminated strings, image data), 4-byte aligned
+ *
+ * All offsets are from the start of the file, except for images which have
+ * been put in the image store, where the offset is into the store. The
+ * compiled file is only ever produced and consumed on the badge, so native
+ * endianness is used.
+ */
+#define PAGE_BIN_MAGIC   0x47504255 // "UBPG"
+#define PAGE_BIN_VERSION 6
+#define PAGE_BIN_EXT     ".pgc"
+
+struct page_bin_header {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t n_items;
+	uint32_t size;
+	// Image store generation, if any items use it
+	uint32_t store_generation;
+	// Hash of the text page this was compiled from
+	uint32_t source_hash;
+};
+
+// Image data is in the image store
+#define PAGE_BIN_ITEM_IMAGE_STORE (1 << 0)
+// Image data is PackBits encoded
+#define PAGE_BIN_ITEM_IMAGE_PACKBITS (1 << 1)
+
+struct page_bin_item {
+	uint8_t type;
+	uint8_t color;
+	uint8_t thickness;
+	uint8_t flags;
+
+	// Pre-measured size for the layout engine
+	int16_t width, height;
+
+	int16_t image_width, image_height;
+	// Fixed point
+	int32_t text_size;
+	int16_t text_baseline;
+	uint16_t reserved;
+
+	uint32_t data_offset;
+	uint32_t data_size;
+};
+
+#define ALIGN_UP(_x, _a) (((_x) + ((_a) - 1)) & ~((_a) - 1))
+
+static char *read_file(lfs_t *lfs, struct page_arena *arena, const char *path, lfs_size_t *size)
+{
+	struct lfs_info st;
+	lfs_file_t fp;
+	int res;
+	char *buf;
+
+	res = lfs_stat(lfs, path, &st);
+	if (res != 0) {
+		return NULL;
+	}
+
+	printf("stat %s: %d\n", path, st.size);
+
+	buf = page_arena_alloc_top(arena, st.size);
+	if (!buf) {
+		return NULL;
+	}
+
+	res = lfs_file_open(lfs, &fp, path, LFS_O_RDONLY);
+	if (res) {
+		return NULL;
+	}
+
+	res = lfs_file_read(lfs, &fp, buf, st.size);
+	lfs_file_close(lfs, &fp);
+	if (res != st.size) {
+		return NULL;
+	}
+
+	if (size) {
+		*size = st.size;
+	}
+
+	return buf;
+}
+
+// Log a parse error, and record it in 'diag' if there is one. Returns -1
+static int page_error(struct page_diag *diag, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+	printf("\n");
+
+	if (diag) {
+		va_start(ap, fmt);
+		vsnprintf(diag->msg, sizeof(diag->msg), fmt, ap);
+		va_end(ap);
+	}
+
+	return -1;
+}
+
+static int parse_img(lfs_t *lfs, struct page_arena *arena, struct screen_page_item *item, char *buf,
+		struct page_diag *diag)
+{
+	char *tok, *tmp;
+	lfs_size_t size;
+
+	item->type = PAGE_ITEM_TYPE_IMAGE;
+
+	// img
+	tok = strsep(&buf, " ");
+	printf("first tok: %s\n", tok);
+	tmp = index(tok, '.');
+	if (tmp) {
+		printf("font: %s\n", tmp);
+	}
+
+	tok = strsep(&buf, " ");
+	printf("width tok: %s\n", tok);
+	if (!tok || (sscanf(tok, "%d", &item->image.width) != 1) || (item->image.width <= 0)) {
+		return page_error(diag, "bad image width");
+	}
+
+	tok = strsep(&buf, " ");
+	printf("height tok: %s\n", tok);
+	if (!tok || (sscanf(tok, "%d", &item->image.height) != 1) || (item->image.height <= 0)) {
+		return page_error(diag, "bad image height");
+	}
+
+	tok = strsep(&buf, " ");
+	printf("path tok: %s\n", tok);
+	if (!tok) {
+		return page_error(diag, "missing image path");
+	}
+
+	if (pnm_is_pnm(tok)) {
+		int width, height;
+		uint8_t *data;
+
+		int res = pnm_load(lfs, arena, tok, &width, &height, &data);
+		if (res) {
+			return page_error(diag, "image '%s': %s", tok, pnm_strerror(res));
+		}
+
+		if ((width != item->image.width) || (height != item->image.height)) {
+			return page_error(diag, "image '%s' is %dx%d", tok, width, height);
+		}
+
+		item->image.data = data;
+	} else {
+		// Rows are whole bytes, with nothing to say how they're padded
+		if (item->image.width % 8) {
+			return page_error(diag, "image '%s': width must be a multiple of 8", tok);
+		}
+
+		item->image.data = (uint8_t *)read_file(lfs, arena, tok, &size);
+		if (!item->image.data) {
+			return page_error(diag, "can't read image '%s'", tok);
+		}
+
+		if (size < (item->image.width / 8) * item->image.height) {
+			return page_error(diag, "image '%s' too short: %d bytes", tok, size);
+		}
+	}
+
+	printf("Parsed image: %d %d '%08x'\n",
+			item->image.width, item->image.height, *(uint32_t *)item->image.data);
+
+	return 0;
+}
+
+// Parse a decimal like "0.35" into fixed point, without going through float
+static int parse_fixed(const char *tok, int32_t *val)
+{
+	int32_t whole = 0;
+	uint32_t frac = 0, div = 1;
+	const char *p = tok;
+
+	if (!*p) {
+		return -1;
+	}
+
+	for ( ; (*p >= '0') && (*p <= '9'); p++) {
+		whole = whole * 10 + (*p - '0');
+		if (whole > (INT32_MAX >> BADGER_FIXED_SHIFT)) {
+			return -1;
+		}
+	}
+
+	if (*p == '.') {
+		for (p++; (*p >= '0') && (*p <= '9'); p++) {
+			// Anything past 5 places is below the fixed point resolution
+			if (div < 100000) {
+				frac = frac * 10 + (*p - '0');
+				div *= 10;
+			}
+		}
+	}
+
+	if (*p) {
+		return -1;
+	}
+
+	*val = (whole << BADGER_FIXED_SHIFT) +
+		(int32_t)((((uint64_t)frac << BADGER_FIXED_SHIFT) + (div / 2)) / div);
+
+	return 0;
+}
+
+static int parse_text(lfs_t *lfs, struct page_arena *arena, struct screen_page_item *item, char *buf,
+		struct page_diag *diag)
+{
+	char *tok, *tmp;
+
+	item->type = PAGE_ITEM_TYPE_TEXT;
+
+	// text.font
+	tok = strsep(&buf, " ");
+	printf("first tok: %s\n", tok);
+	tmp = index(tok, '.');
+	if (tmp) {
+		printf("font: %s\n", tmp);
+	}
+
+	tok = strsep(&buf, " ");
+	printf("size tok: %s\n", tok);
+	if (!tok || parse_fixed(tok, &item->text.size) || (item->text.size <= 0)) {
+		return page_error(diag, "bad text size");
+	}
+
+	tok = strsep(&buf, " ");
+	printf("color tok: %s\n", tok);
+	if (!tok || (sscanf(tok, "%hhd", &item->text.color) != 1) || (item->text.color > 15)) {
+		return page_error(diag, "bad text color, should be 0-15");
+	}
+
+	tok = strsep(&buf, " ");
+	printf("thickness tok: %s\n", tok);
+	if (!tok || (sscanf(tok, "%hhd", &item->text.thickness) != 1) || (item->text.thickness == 0)) {
+		return page_error(diag, "bad text thickness");
+	}
+
+	tok = strsep(&buf, "\n");
+	printf("text tok: %s\n", tok);
+	if (!tok) {
+		return page_error(diag, "missing text");
+	}
+
+	item->text.text = page_arena_alloc_top(arena, strlen(tok) + 1);
+	if (!item->text.text) {
+		return page_error(diag, "page too big");
+	}
+	strcpy(item->text.text, tok);
+
+	printf("Parsed text: %d/%d %d %d '%s'\n", (int)item->text.size, BADGER_FIXED_ONE,
+			item->text.color, item->text.thickness, item->text.text);
+
+	return 0;
+}
+
+void screen_page_free(struct screen_page *page)
+{
+	if (!page) {
+		return;
+	}
+
+	// Everything belonging to the page is in its arena
+	page_arena_put(page->arena);
+}
+
+/*
+ * Pulls lines out of a file through a fixed-size window, so parsing a page
+ * never needs more memory than one line, however big the file is.
+ */
+struct line_reader {
+	lfs_t *lfs;
+	lfs_file_t *fp;
+	char buf[PAGE_LINE_MAX + 1];
+	int len;
+	int pos;
+	bool eof;
+	uint32_t hash;
+};
+
+// Returns 1 and points 'line' at the next (NUL-terminated) line, 0 at the
+// end of the file, or < 0 on error
+static int line_reader_next(struct line_reader *lr, char **line)
+{
+	for ( ;; ) {
+		char *nl = memchr(&lr->buf[lr->pos], '\n', lr->len - lr->pos);
+		if (nl) {
+			*nl = '\0';
+			*line = &lr->buf[lr->pos];
+			lr->pos = (nl - lr->buf) + 1;
+			return 1;
+		}
+
+		// Shuffle the partial line down to make space
+		lr->len -= lr->pos;
+		memmove(lr->buf, &lr->buf[lr->pos], lr->len);
+		lr->pos = 0;
+
+		if (lr->eof) {
+			if (lr->len == 0) {
+				return 0;
+			}
+
+			// Last line without a newline
+			lr->buf[lr->len] = '\0';
+			*line = lr->buf;
+			lr->pos = lr->len;
+			return 1;
+		}
+
+		if (lr->len == PAGE_LINE_MAX) {
+			printf("line too long\n");
+			return LFS_ERR_FBIG;
+		}
+
+		int res = lfs_file_read(lr->lfs, lr->fp, &lr->buf[lr->len], PAGE_LINE_MAX - lr->len);
+		if (res < 0) {
+			return res;
+		} else if (res == 0) {
+			lr->eof = true;
+		}
+
+		lr->hash = fnv1a_update(lr->hash, &lr->buf[lr->len], res);
+		lr->len += res;
+	}
+}
+
+int page_parse(lfs_t *lfs, struct page_arena *arena, const char *path,
+		int (*emit)(void *user, struct screen_page_item *item), void *user,
+		uint32_t *hash, struct page_diag *diag)
+{
+	struct line_reader lr = { 0 };
+	lfs_file_t fp;
+	char *line;
+	int res, n_lines = 0;
+
+	if (diag) {
+		diag->line = 0;
+		diag->msg[0] = '\0';
+	}
+
+	res = lfs_file_open(lfs, &fp, path, LFS_O_RDONLY);
+	if (res) {
+		page_error(diag, "can't open: %d", res);
+		return res;
+	}
+
+	lr.lfs = lfs;
+	lr.fp = &fp;
+	lr.hash = FNV1A_INIT;
+
+	while ((res = line_reader_next(&lr, &line)) > 0) {
+		struct screen_page_item item = { 0 };
+
+		printf("line: %d, %s\n", n_lines++, line);
+		if (diag) {
+			diag->line = n_lines;
+		}
+
+		if (strncmp(line, "text", strlen("text")) == 0) {
+			res = parse_text(lfs, arena, &item, line, diag);
+		} else if (strncmp(line, "img", strlen("img")) == 0) {
+			res = parse_img(lfs, arena, &item, line, diag);
+		} else {
+			printf("skip unknown type: '%s'\n", line);
+			continue;
+		}
+
+		if (res) {
+			break;
+		}
+
+		page_item_calculate_size(&item);
+
+		res = emit(user, &item);
+		if (res) {
+			page_error(diag, "page too big");
+			break;
+		}
+	}
+
+	lfs_file_close(lfs, &fp);
+
+	if (res == LFS_ERR_FBIG) {
+		if (diag) {
+			diag->line = n_lines + 1;
+		}
+		page_error(diag, "line too long, max %d characters", PAGE_LINE_MAX);
+	} else if (res < 0 && diag && !diag->msg[0]) {
+		page_error(diag, "read error: %d", res);
+	}
+
+	if (hash) {
+		*hash = lr.hash;
+	}
+
+	return res;
+}
+
+static int page_append_item(void *user, struct screen_page_item *item)
+{
+	struct screen_page *page = user;
+
+	if ((page->n_items & (page->n_items - 1)) == 0) {
+		// Grow in powers of two
+		int capacity = page->n_items ? page->n_items * 2 : 1;
+		void *items = page_arena_realloc(page->arena, page->items, capacity * sizeof(*page->items));
+		if (!items) {
+			return LFS_ERR_NOMEM;
+		}
+		page->items = items;
+	}
+
+	page->items[page->n_items++] = *item;
+
+	return 0;
+}
+
+static struct screen_page *screen_page_alloc(void)
+{
+	struct page_arena *arena = page_arena_get();
+	if (!arena) {
+		return NULL;
+	}
+
+	struct screen_page *page = page_arena_alloc_top(arena, sizeof(*page));
+	if (!page) {
+		page_arena_put(arena);
+		return NULL;
+	}
+
+	memset(page, 0, sizeof(*page));
+	page->arena = arena;
+
+	return page;
+}
+
+static struct screen_page *parse_file_diag(lfs_t *lfs, const char *path, struct page_diag *diag)
+{
+	struct screen_page *page = screen_page_alloc();
+	if (!page) {
+		page_error(diag, "out of memory");
+		return NULL;
+	}
+
+	int res = page_parse(lfs, page->arena, path, page_append_item, page, &page->hash, diag);
+
+	printf("res: %d, n_items: %d\n", res, page->n_items);
+
+	if (res) {
+		screen_page_free(page);
+		page = NULL;
+	}
+
+	return page;
+}
+
+struct screen_page *parse_file(lfs_t *lfs, const char *path)
+{
+	return parse_file_diag(lfs, path, NULL);
+}
+
+static uint32_t page_item_data_size(struct screen_page_item *item)
+{
+	switch (item->type) {
+	case PAGE_ITEM_TYPE_IMAGE:
+		if (item->image.packed_size) {
+			return item->image.packed_size;
+		}
+		return (item->image.width / 8) * item->image.height;
+	case PAGE_ITEM_TYPE_TEXT:
+		return strlen(item->text.text) + 1;
+	default:
+		return 0;
+	}
+}
+
+static const void *page_item_data(struct screen_page_item *item)
+{
+	switch (item->type) {
+	case PAGE_ITEM_TYPE_IMAGE:
+		return item->image.data;
+	case PAGE_ITEM_TYPE_TEXT:
+		return item->text.text;
+	default:
+		return NULL;
+	}
+}
+
+struct screen_page *page_load_compiled(lfs_t *lfs, const char *path)
+{
+	struct page_bin_header hdr;
+	struct lfs_info st;
+	lfs_file_t fp;
+	int res;
+
+	res = lfs_stat(lfs, path, &st);
+	if (res != 0) {
+		return NULL;
+	}
+
+	res = lfs_file_open(lfs, &fp, path, LFS_O_RDONLY);
+	if (res) {
+		return NULL;
+	}
+
+	res = lfs_file_read(lfs, &fp, &hdr, sizeof(hdr));
+	if ((res != sizeof(hdr)) || (hdr.magic != PAGE_BIN_MAGIC) ||
+	    (hdr.version != PAGE_BIN_VERSION) || (hdr.size != st.size) ||
+	    (hdr.n_items == 0)) {
+		printf("bad compiled page %s: %d\n", path, res);
+		lfs_file_close(lfs, &fp);
+		return NULL;
+	}
+
+	uint32_t store_generation = 0;
+	if (hdr.store_generation) {
+		res = image_store_generation(lfs, &store_generation);
+		if (res || (store_generation != hdr.store_generation)) {
+			printf("stale image store for %s: %d\n", path, res);
+			lfs_file_close(lfs, &fp);
+			return NULL;
+		}
+	}
+
+	struct screen_page *page = screen_page_alloc();
+	if (!page) {
+		lfs_file_close(lfs, &fp);
+		return NULL;
+	}
+
+	page->hash = hdr.source_hash;
+	page->items = page_arena_alloc_top(page->arena, hdr.n_items * sizeof(*page->items));
+	uint8_t *data = page_arena_alloc_top(page->arena, hdr.size);
+	if (!page->items || !data) {
+		lfs_file_close(lfs, &fp);
+		screen_page_free(page);
+		return NULL;
+	}
+	memset(page->items, 0, hdr.n_items * sizeof(*page->items));
+
+	memcpy(data, &hdr, sizeof(hdr));
+	res = lfs_file_read(lfs, &fp, data + sizeof(hdr), hdr.size - sizeof(hdr));
+	lfs_file_close(lfs, &fp);
+	if (res != hdr.size - sizeof(hdr)) {
+		goto err_free;
+	}
+
+	struct page_bin_item *bin_items = (struct page_bin_item *)(data + sizeof(hdr));
+	uint32_t data_start = sizeof(hdr) + hdr.n_items * sizeof(*bin_items);
+	if (data_start > hdr.size) {
+		goto err_free;
+	}
+
+	for (int i = 0; i < hdr.n_items; i++) {
+		struct page_bin_item *bin = &bin_items[i];
+		struct screen_page_item *item = &page->items[i];
+
+		if (bin->flags & PAGE_BIN_ITEM_IMAGE_STORE) {
+			if ((bin->type != PAGE_ITEM_TYPE_IMAGE) || !hdr.store_generation) {
+				goto err_free;
+			}
+		} else if ((bin->data_offset < data_start) || (bin->data_offset > hdr.size) ||
+			   (bin->data_size > hdr.size - bin->data_offset)) {
+			goto err_free;
+		}
+
+		item->type = bin->type;
+		item->width = bin->width;
+		item->height = bin->height;
+
+		switch (item->type) {
+		case PAGE_ITEM_TYPE_IMAGE:
+			item->image.width = bin->image_width;
+			item->image.height = bin->image_height;
+			if (item->image.width % 8) {
+				goto err_free;
+			}
+			if (bin->flags & PAGE_BIN_ITEM_IMAGE_PACKBITS) {
+				item->image.packed_size = bin->data_size;
+			} else if (bin->data_size < (item->image.width / 8) * item->image.height) {
+				goto err_free;
+			}
+			if (bin->flags & PAGE_BIN_ITEM_IMAGE_STORE) {
+				item->image.data = image_store_data(lfs, bin->data_offset, bin->data_size);
+				if (!item->image.data) {
+					goto err_free;
+				}
+			} else {
+				item->image.data = data + bin->data_offset;
+			}
+			break;
+		case PAGE_ITEM_TYPE_TEXT:
+			if ((bin->data_size == 0) || data[bin->data_offset + bin->data_size - 1] != '\0') {
+				goto err_free;
+			}
+			item->text.size = bin->text_size;
+			item->text.color = bin->color;
+			item->text.thickness = bin->thickness;
+			item->text.baseline = bin->text_baseline;
+			item->text.text = (char *)data + bin->data_offset;
+			break;
+		default:
+			goto err_free;
+		}
+	}
+
+	page->n_items = hdr.n_items;
+
+	return page;
+
+err_free:
+	printf("corrupt compiled page %s\n", path);
+	screen_page_free(page);
+	return NULL;
+}
+
+int page_compiled_path(char *buf, size_t len, const char *src)
+{
+	const char *ext = rindex(src, '.');
+	int base_len = ext ? ext - src : strlen(src);
+
+	int res = snprintf(buf, len, "%s/%.*s%s", PAGE_SYS_DIR, base_len, src, PAGE_BIN_EXT);
+	if (res < 0 || res >= len) {
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * The result of laying out a page is stored as an attribute on the text page,
+ * tagged with the hash of the page source. If the page is changed over USB,
+ * the hash won't match any more and the layout is redone.
+ */
+#define PAGE_LAYOUT_ATTR 'L'
+// Bump this when changes to the layout or text measuring code would change
+// the result of laying out the same page
+#define PAGE_LAYOUT_VERSION 3
+#define PAGE_LAYOUT_MAX_ITEMS 32
+
+struct page_layout_cache {
+	uint32_t hash;
+	uint16_t version;
+	uint16_t n_items;
+	lay_vec4 rects[PAGE_LAYOUT_MAX_ITEMS];
+};
+
+int page_layout_load(lfs_t *lfs, const char *path, struct screen_page *page)
+{
+	struct page_layout_cache cache;
+	lfs_ssize_t size = offsetof(struct page_layout_cache, rects[page->n_items]);
+
+	if (page->n_items > PAGE_LAYOUT_MAX_ITEMS) {
+		return -1;
+	}
+
+	lfs_ssize_t res = lfs_getattr(lfs, path, PAGE_LAYOUT_ATTR, &cache, sizeof(cache));
+	if (res != size) {
+		return res < 0 ? res : -1;
+	}
+
+	if ((cache.hash != page->hash) || (cache.version != PAGE_LAYOUT_VERSION) ||
+	    (cache.n_items != page->n_items)) {
+		printf("stale layout for %s\n", path);
+		return -1;
+	}
+
+	for (int i = 0; i < page->n_items; i++) {
+		page->items[i].rect = cache.rects[i];
+	}
+	page->laid_out = true;
+
+	return 0;
+}
+
+int page_layout_store(lfs_t *lfs, const char *path, struct screen_page *page)
+{
+	struct page_layout_cache cache = {
+		.hash = page->hash,
+		.version = PAGE_LAYOUT_VERSION,
+		.n_items = page->n_items,
+	};
+
+	if (!page->laid_out || (page->n_items > PAGE_LAYOUT_MAX_ITEMS)) {
+		return -1;
+	}
+
+	for (int i = 0; i < page->n_items; i++) {
+		cache.rects[i] = page->items[i].rect;
+	}
+
+	return lfs_setattr(lfs, path, PAGE_LAYOUT_ATTR, &cache,
+			offsetof(struct page_layout_cache, rects[page->n_items]));
+}
+
+struct screen_page *page_load(lfs_t *lfs, const char *path)
+{
+	char compiled_path[LFS_NAME_MAX + 1];
+	struct screen_page *page = NULL;
+
+	if (!page_compiled_path(compiled_path, sizeof(compiled_path), path)) {
+		page = page_load_compiled(lfs, compiled_path);
+	}
+
+	if (!page) {
+		printf("no compiled page for %s\n", path);
+		page = parse_file(lfs, path);
+		if (!page) {
+			return NULL;
+		}
+	}
+
+	if (page->n_items && page_layout_load(lfs, path, page)) {
+		screen_page_layout(page);
+
+		int res = page_layout_store(lfs, path, page);
+		printf("stored layout for %s: %d\n", path, res);
+	}
+
+	return page;
+}
+
+// PackBits encode any images which get smaller, to save flash and the time
+// to read it. The encoded data is allocated from the page's arena, and if
+// there's no room the image is just left as it is.
+static void page_pack_images(struct screen_page *page)
+{
+	for (int i = 0; i < page->n_items; i++) {
+		struct screen_page_item *item = &page->items[i];
+
+		if ((item->type != PAGE_ITEM_TYPE_IMAGE) || item->image.packed_size) {
+			continue;
+		}
+
+		uint32_t size = (item->image.width / 8) * item->image.height;
+		uint8_t *packed = page_arena_alloc_top(page->arena, size);
+		if (!packed) {
+			continue;
+		}
+
+		uint32_t packed_size = packbits_encode(item->image.data, size, packed, size - 1);
+		printf("packed image %d: %d -> %d\n", i, size, packed_size);
+		if (packed_size) {
+			item->image.data = packed;
+			item->image.packed_size = packed_size;
+		}
+	}
+}
+
+int page_compile(lfs_t *lfs, struct image_store *store, const char *src, const char *dst,
+		struct page_diag *diag)
+{
+	struct page_bin_item *bins;
+	lfs_file_t fp;
+	int res;
+
+	struct screen_page *page = parse_file_diag(lfs, src, diag);
+	if (!page) {
+		return 1;
+	} else if (page->n_items == 0) {
+		if (diag) {
+			diag->line = 0;
+		}
+		page_error(diag, "no page items");
+		screen_page_free(page);
+		return 1;
+	}
+
+	bins = calloc(page->n_items, sizeof(*bins));
+	if (!bins) {
+		screen_page_free(page);
+		return LFS_ERR_NOMEM;
+	}
+
+	struct page_bin_header hdr = {
+		.magic = PAGE_BIN_MAGIC,
+		.version = PAGE_BIN_VERSION,
+		.n_items = page->n_items,
+		.source_hash = page->hash,
+	};
+
+	page_pack_images(page);
+
+	uint32_t offset = sizeof(hdr) + page->n_items * sizeof(*bins);
+	for (int i = 0; i < page->n_items; i++) {
+		struct screen_page_item *item = &page->items[i];
+		struct page_bin_item *bin = &bins[i];
+
+		bin->type = item->type;
+		bin->width = item->width;
+		bin->height = item->height;
+		bin->data_size = page_item_data_size(item);
+
+		if (item->type == PAGE_ITEM_TYPE_IMAGE) {
+			bin->image_width = item->image.width;
+			bin->image_height = item->image.height;
+			if (item->image.packed_size) {
+				bin->flags |= PAGE_BIN_ITEM_IMAGE_PACKBITS;
+			}
+
+			// Prefer the image store, but if it's full just embed the image
+			if (store && !image_store_add(store, item->image.data, bin->data_size, &bin->data_offset)) {
+				bin->flags |= PAGE_BIN_ITEM_IMAGE_STORE;
+				hdr.store_generation = store->generation;
+				continue;
+			}
+		} else if (item->type == PAGE_ITEM_TYPE_TEXT) {
+			bin->text_size = item->text.size;
+			bin->color = item->text.color;
+			bin->thickness = item->text.thickness;
+			bin->text_baseline = item->text.baseline;
+		}
+
+		bin->data_offset = ALIGN_UP(offset, 4);
+		offset = bin->data_offset + bin->data_size;
+	}
+	hdr.size = offset;
+
+	res = lfs_file_open(lfs, &fp, dst, LFS_O_CREAT | LFS_O_TRUNC | LFS_O_WRONLY);
+	if (res) {
+		page_error(diag, "can't write %s: %d", dst, res);
+		goto err_free;
+	}
+
+	res = lfs_file_write(lfs, &fp, &hdr, sizeof(hdr));
+	if (res != sizeof(hdr)) {
+		goto err_close;
+	}
+
+	res = lfs_file_write(lfs, &fp, bins, page->n_items * sizeof(*bins));
+	if (res != page->n_items * sizeof(*bins)) {
+		goto err_close;
+	}
+
+	offset = sizeof(hdr) + page->n_items * sizeof(*bins);
+	for (int i = 0; i < page->n_items; i++) {
+		struct page_bin_item *bin = &bins[i];
+		const uint32_t zero = 0;
+
+		if (bin->flags & PAGE_BIN_ITEM_IMAGE_STORE) {
+			continue;
+		}
+
+		if (bin->data_offset > offset) {
+			res = lfs_file_write(lfs, &fp, &zero, bin->data_offset - offset);
+			if (res != bin->data_offset - offset) {
+				goto err_close;
+			}
+		}
+
+		res = lfs_file_write(lfs, &fp, page_item_data(&page->items[i]), bin->data_size);
+		if (res != bin->data_size) {
+			goto err_close;
+		}
+
+		offset = bin->data_offset + bin->data_size;
+	}
+
+	free(bins);
+	screen_page_free(page);
+
+	res = lfs_file_close(lfs, &fp);
+	printf("compiled %s -> %s (%d bytes): %d\n", src, dst, offset, res);
+
+	return res;
+
+err_close:
+	page_error(diag, "failed writing %s: %d", dst, res);
+	lfs_file_close(lfs, &fp);
+	lfs_remove(lfs, dst);
+	res = res < 0 ? res : LFS_ERR_IO;
+err_free:
+	free(bins);
+	screen_page_free(page);
+	return res;
+}
+
+/*
+ * The manifest lists the pages which can be navigated through, in order:
+ * main.txt first, then pageN.txt in order of N. Only pages which compiled
+ * are listed.
+ *
+ *   struct page_manifest_header
+ *   struct page_manifest_entry[n_pages]
+ *   NUL-terminated page names, at the offsets in the entries
+ */
+#define PAGE_MANIFEST_MAGIC   0x4d504255 // "UBPM"
+#define PAGE_MANIFEST_VERSION 1
+
+struct page_manifest_header {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t n_pages;
+};
+
+struct page_manifest_entry {
+	// Size of the compiled page
+	uint32_t size;
+	// Offset of the name from the start of the file
+	uint32_t name_offset;
+};
+
+// Order in the manifest, or -1 if the page shouldn't be in it
+static int page_manifest_rank(const char *name)
+{
+	int n, len;
+
+	if (strcmp(name, "main.txt") == 0) {
+		return 0;
+	}
+
+	if ((sscanf(name, "page%d.txt%n", &n, &len) == 1) &&
+	    (len == strlen(name)) && (n > 0)) {
+		return n;
+	}
+
+	return -1;
+}
+
+struct page_manifest_builder {
+	int n_pages;
+	struct {
+		int rank;
+		uint32_t size;
+		char name[PAGE_MANIFEST_NAME_MAX];
+	} pages[PAGE_MANIFEST_MAX_PAGES];
+};
+
+static void page_manifest_add(struct page_manifest_builder *builder, const char *name, uint32_t size)
+{
+	int rank = page_manifest_rank(name);
+
+	if ((rank < 0) || (strlen(name) >= PAGE_MANIFEST_NAME_MAX)) {
+		return;
+	}
+
+	if (builder->n_pages >= PAGE_MANIFEST_MAX_PAGES) {
+		printf("too many pages, dropping %s\n", name);
+		return;
+	}
+
+	// Insertion sort by rank
+	int i = builder->n_pages++;
+	while ((i > 0) && (builder->pages[i - 1].rank > rank)) {
+		builder->pages[i] = builder->pages[i - 1];
+		i--;
+	}
+
+	builder->pages[i].rank = rank;
+	builder->pages[i].size = size;
+	strcpy(builder->pages[i].name, name);
+}
+
+static int page_manifest_write(lfs_t *lfs, struct page_manifest_builder *builder)
+{
+	lfs_file_t fp;
+	int res;
+
+	struct page_manifest_header hdr = {
+		.magic = PAGE_MANIFEST_MAGIC,
+		.version = PAGE_MANIFEST_VERSION,
+		.n_pages = builder->n_pages,
+	};
+
+	res = lfs_file_open(lfs, &fp, PAGE_MANIFEST_PATH, LFS_O_CREAT | LFS_O_TRUNC | LFS_O_WRONLY);
+	if (res) {
+		return res;
+	}
+
+	res = lfs_file_write(lfs, &fp, &hdr, sizeof(hdr));
+	if (res != sizeof(hdr)) {
+		goto err_close;
+	}
+
+	uint32_t name_offset = sizeof(hdr) + builder->n_pages * sizeof(struct page_manifest_entry);
+	for (int i = 0; i < builder->n_pages; i++) {
+		struct page_manifest_entry entry = {
+			.size = builder->pages[i].size,
+			.name_offset = name_offset,
+		};
+
+		res = lfs_file_write(lfs, &fp, &entry, sizeof(entry));
+		if (res != sizeof(entry)) {
+			goto err_close;
+		}
+
+		name_offset += strlen(builder->pages[i].name) + 1;
+	}
+
+	if (name_offset > PAGE_MANIFEST_MAX_SIZE) {
+		res = LFS_ERR_FBIG;
+		goto err_close;
+	}
+
+	for (int i = 0; i < builder->n_pages; i++) {
+		int len = strlen(builder->pages[i].name) + 1;
+
+		res = lfs_file_write(lfs, &fp, builder->pages[i].name, len);
+		if (res != len) {
+			goto err_close;
+		}
+	}
+
+	res = lfs_file_close(lfs, &fp);
+	printf("wrote manifest, %d pages: %d\n", builder->n_pages, res);
+
+	return res;
+
+err_close:
+	lfs_file_close(lfs, &fp);
+	lfs_remove(lfs, PAGE_MANIFEST_PATH);
+	return res < 0 ? res : LFS_ERR_IO;
+}
+
+int page_manifest_load(lfs_t *lfs, struct page_manifest *manifest)
+{
+	struct page_manifest_header *hdr = (struct page_manifest_header *)manifest->buf;
+	lfs_file_t fp;
+	int res;
+
+	manifest->n_pages = 0;
+
+	res = lfs_file_open(lfs, &fp, PAGE_MANIFEST_PATH, LFS_O_RDONLY);
+	if (res) {
+		return res;
+	}
+
+	res = lfs_file_read(lfs, &fp, manifest->buf, sizeof(manifest->buf));
+	lfs_file_close(lfs, &fp);
+	if (res < 0) {
+		return res;
+	}
+
+	size_t size = res;
+	if ((size < sizeof(*hdr)) || (hdr->magic != PAGE_MANIFEST_MAGIC) ||
+	    (hdr->version != PAGE_MANIFEST_VERSION) ||
+	    (size < sizeof(*hdr) + hdr->n_pages * sizeof(struct page_manifest_entry))) {
+		return LFS_ERR_CORRUPT;
+	}
+
+	// Make sure all of the names are in bounds and terminated
+	struct page_manifest_entry *entries = (struct page_manifest_entry *)(hdr + 1);
+	for (int i = 0; i < hdr->n_pages; i++) {
+		uint32_t offset = entries[i].name_offset;
+
+		if ((offset >= size) || !memchr(&manifest->buf[offset], '\0', size - offset)) {
+			return LFS_ERR_CORRUPT;
+		}
+	}
+
+	manifest->n_pages = hdr->n_pages;
+
+	return 0;
+}
+
+const char *page_manifest_path(const struct page_manifest *manifest, int idx)
+{
+	const struct page_manifest_header *hdr = (const struct page_manifest_header *)manifest->buf;
+	const struct page_manifest_entry *entries = (const struct page_manifest_entry *)(hdr + 1);
+
+	if ((idx < 0) || (idx >= manifest->n_pages)) {
+		return NULL;
+	}
+
+	return (const char *)&manifest->buf[entries[idx].name_offset];
+}
+
+int page_compile_all(lfs_t *lfs,
+		void (*report)(void *user, const char *name, int res, const struct page_diag *diag),
+		void *user)
+{
+	struct page_diag diag;
+	static struct image_store store;
+	static struct page_manifest_builder manifest;
+	char dst[LFS_NAME_MAX + 1];
+	struct lfs_info dirent;
+	lfs_dir_t dir;
+	int res;
+
+	res = lfs_mkdir(lfs, PAGE_SYS_DIR);
+	if (res && res != LFS_ERR_EXIST) {
+		return res;
+	}
+
+	// Every page gets recompiled, so the image store can start from scratch.
+	// Without it, images are kept in the compiled pages in littlefs instead.
+	struct image_store *use_store = &store;
+	res = image_store_begin(&store, lfs);
+	if (res) {
+		printf("not using the image store: %d\n", res);
+		use_store = NULL;
+	}
+
+	res = lfs_dir_open(lfs, &dir, "");
+	if (res < 0) {
+		return res;
+	}
+
+	manifest.n_pages = 0;
+	glyph_cache_clear();
+
+	int dir_res;
+	while ((dir_res = lfs_dir_read(lfs, &dir, &dirent)) > 0) {
+		struct lfs_info st;
+
+		if (dirent.type != LFS_TYPE_REG) {
+			continue;
+		}
+
+		if (page_compiled_path(dst, sizeof(dst), dirent.name)) {
+			continue;
+		}
+
+		// Only the pages which can be navigated to, not every .txt file
+		// (e.g. readme.txt). Other text files are loaded from the text,
+		// so don't leave an old compiled copy of one around.
+		if (page_manifest_rank(dirent.name) < 0) {
+			const char *ext = rindex(dirent.name, '.');
+			if (ext && (strcmp(ext, ".txt") == 0)) {
+				lfs_remove(lfs, dst);
+			}
+			continue;
+		}
+
+		res = page_compile(lfs, use_store, dirent.name, dst, &diag);
+		if (report) {
+			report(user, dirent.name, res, &diag);
+		}
+
+		if (res < 0) {
+			break;
+		} else if (res > 0) {
+			// Broken or not a page, make sure there's nothing stale left
+			// behind, and leave it out of the manifest so it's never loaded
+			printf("not compiling %s\n", dirent.name);
+			lfs_remove(lfs, dst);
+			res = 0;
+			continue;
+		}
+
+		res = lfs_stat(lfs, dst, &st);
+		if (res) {
+			break;
+		}
+
+		// Do the layout and stroke the text now too, so it's cached before
+		// running on battery
+		struct screen_page *page = page_load(lfs, dirent.name);
+		if (page) {
+			screen_page_cache_glyphs(page);
+			screen_page_free(page);
+		}
+
+		page_manifest_add(&manifest, dirent.name, st.size);
+	}
+
+	lfs_dir_close(lfs, &dir);
+
+	if (dir_res < 0) {
+		return dir_res;
+	} else if (res) {
+		return res;
+	}
+
+	// Not fatal, text just gets stroked on the badge instead
+	res = glyph_cache_save(lfs, GLYPH_CACHE_PATH);
+	if (res) {
+		printf("failed to save glyph cache: %d\n", res);
+	}
+
+	return page_manifest_write(lfs, &manifest);
+}
@@ -0,0 +1,87 @@
+#ifndef __PAGE_FILE_H__
+#define __PAGE_FILE_H__
+
+#include "littlefs/lfs.h"
+
+#include "image_store.h"
+#include "page_arena.h"
+#include "screen_page.h"
+
+// Generated files live in here, so they never get copied onto the USB disk
+#define PAGE_SYS_DIR "sys"
+// Glyphs for every page, stroked at sync time
+#define GLYPH_CACHE_PATH PAGE_SYS_DIR "/glyphs.bin"
+
+// Longest line allowed in a text page
+#define PAGE_LINE_MAX 128
+
+// Why a page couldn't be parsed or compiled
+struct page_diag {
+	// 1-based line number, or 0 if it's not about a specific line
+	int line;
+	char msg[64];
+};
+
+// Parse a text page (the authoring format), calling 'emit' for each item as
+// it is parsed. Item data is allocated from 'arena'.
+// If 'hash' isn't NULL, it's set to the hash of the file contents.
+// If 'diag' isn't NULL, it's filled in when parsing fails.
+int page_parse(lfs_t *lfs, struct page_arena *arena, const char *path,
+		int (*emit)(void *user, struct screen_page_item *item), void *user,
+		uint32_t *hash, struct page_diag *diag);
+
+// Parse a text page into a screen_page
+struct screen_page *parse_file(lfs_t *lfs, const char *path);
+
+// Load a page compiled by page_compile()
+struct screen_page *page_load_compiled(lfs_t *lfs, const char *path);
+
+// Load the compiled version of 'path' if there is one, otherwise parse the text.
+// The page is laid out, using the layout cached on 'path' if it's up-to-date.
+struct screen_page *page_load(lfs_t *lfs, const char *path);
+
+// Fill in the item rects from the layout cached on 'path'
+// Returns 0 on success, non-zero if there's no valid cached layout
+int page_layout_load(lfs_t *lfs, const char *path, struct screen_page *page);
+
+// Cache the item rects of a laid out page on 'path'
+int page_layout_store(lfs_t *lfs, const char *path, struct screen_page *page);
+
+// Parse the text page at 'src' and write the compiled version to 'dst'.
+// Image data goes in 'store' if there is one and there's space.
+// Returns 0 on success, 1 if 'src' isn't a valid page, < 0 on error.
+// 'diag' (if not NULL) says what was wrong when the result isn't 0.
+int page_compile(lfs_t *lfs, struct image_store *store, const char *src, const char *dst,
+		struct page_diag *diag);
+
+// Compile and lay out the pages in the root directory (main.txt and pageN.txt)
+// into PAGE_SYS_DIR, and write the manifest of pages which compiled.
+// 'report' (if not NULL) is called with the page_compile() result for each page.
+int page_compile_all(lfs_t *lfs,
+		void (*report)(void *user, const char *name, int res, const struct page_diag *diag),
+		void *user);
+
+#define PAGE_MANIFEST_PATH      PAGE_SYS_DIR "/pages.idx"
+#define PAGE_MANIFEST_MAX_PAGES 32
+#define PAGE_MANIFEST_NAME_MAX  32
+#define PAGE_MANIFEST_MAX_SIZE  1024
+
+// The ordered list of valid pages, written at sync time
+struct page_manifest {
+	int n_pages;
+	uint8_t buf[PAGE_MANIFEST_MAX_SIZE];
+};
+
+// Returns 0 on success, in which case 'manifest->n_pages' is valid
+int page_manifest_load(lfs_t *lfs, struct page_manifest *manifest);
+
+// Get the path of page 'idx', or NULL if it's out of range
+const char *page_manifest_path(const struct page_manifest *manifest, int idx);
+
+// "main.txt" -> "sys/main.pgc"
+int page_compiled_path(char *buf, size_t len, const char *src);
+
+// Releases the page's arena
+void screen_page_free(struct screen_page *page);
+
+#endif /* __PAGE_FILE_H__ */
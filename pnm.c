@@ -0,0 +1,243 @@
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#include "pnm.h"
+
+// The header has to fit in here, including any comments
+#define PNM_HEADER_MAX 128
+
+struct pnm_reader {
+	lfs_t *lfs;
+	lfs_file_t *fp;
+	int len, pos;
+	uint8_t buf[64];
+};
+
+bool pnm_is_pnm(const char *path)
+{
+	const char *ext = strrchr(path, '.');
+
+	return ext && (!strcasecmp(ext, ".pbm") || !strcasecmp(ext, ".pgm"));
+}
+
+const char *pnm_strerror(int err)
+{
+	switch (err) {
+	case PNM_ERR_IO:
+		return "can't read";
+	case PNM_ERR_FORMAT:
+		return "bad header";
+	case PNM_ERR_UNSUPPORTED:
+		return "only binary PBM (P4) and PGM (P5) are supported";
+	case PNM_ERR_WIDTH:
+		return "width must be a multiple of 8";
+	case PNM_ERR_NOMEM:
+		return "too big";
+	case PNM_ERR_SHORT:
+		return "file too short";
+	default:
+		return "unknown error";
+	}
+}
+
+static int pnm_getc(struct pnm_reader *r)
+{
+	if (r->pos == r->len) {
+		r->len = lfs_file_read(r->lfs, r->fp, r->buf, sizeof(r->buf));
+		r->pos = 0;
+		if (r->len <= 0) {
+			r->len = 0;
+			return -1;
+		}
+	}
+
+	return r->buf[r->pos++];
+}
+
+static bool pnm_isspace(char c)
+{
+	return (c == ' ') || (c == '\t') || (c == '\r') || (c == '\n');
+}
+
+// Parse the next number in the header, skipping whitespace and comments
+static int pnm_header_uint(const char *buf, int len, int *pos, int *val)
+{
+	int p = *pos, v = 0;
+
+	while (p < len) {
+		if (buf[p] == '#') {
+			while ((p < len) && (buf[p] != '\n')) {
+				p++;
+			}
+		} else if (pnm_isspace(buf[p])) {
+			p++;
+		} else {
+			break;
+		}
+	}
+
+	if ((p >= len) || (buf[p] < '0') || (buf[p] > '9')) {
+		return PNM_ERR_FORMAT;
+	}
+
+	for ( ; (p < len) && (buf[p] >= '0') && (buf[p] <= '9'); p++) {
+		v = v * 10 + (buf[p] - '0');
+		if (v > 65535) {
+			return PNM_ERR_FORMAT;
+		}
+	}
+
+	// A number is always followed by whitespace
+	if ((p >= len) || !pnm_isspace(buf[p])) {
+		return PNM_ERR_FORMAT;
+	}
+
+	*pos = p;
+	*val = v;
+
+	return 0;
+}
+
+// PBM is 1 for black, the renderer is 1 for white
+static int pnm_convert_pbm(struct pnm_reader *r, uint8_t *data, int size)
+{
+	for (int i = 0; i < size; i++) {
+		int c = pnm_getc(r);
+		if (c < 0) {
+			return PNM_ERR_SHORT;
+		}
+
+		data[i] = ~c;
+	}
+
+	return 0;
+}
+
+// Dither greyscale with an 8x8 ordered dither, which is cheap and gives 64
+// levels, and doesn't need any state carried between pixels
+static int pnm_convert_pgm(struct pnm_reader *r, uint8_t *data, int width, int height, int maxval)
+{
+	static const uint8_t bayer[8][8] = {
+		{  0, 32,  8, 40,  2, 34, 10, 42 },
+		{ 48, 16, 56, 24, 50, 18, 58, 26 },
+		{ 12, 44,  4, 36, 14, 46,  6, 38 },
+		{ 60, 28, 52, 20, 62, 30, 54, 22 },
+		{  3, 35, 11, 43,  1, 33,  9, 41 },
+		{ 51, 19, 59, 27, 49, 17, 57, 25 },
+		{ 15, 47,  7, 39, 13, 45,  5, 37 },
+		{ 63, 31, 55, 23, 61, 29, 53, 21 },
+	};
+	int row_bytes = width / 8;
+
+	memset(data, 0, row_bytes * height);
+
+	for (int y = 0; y < height; y++) {
+		uint8_t *row = &data[y * row_bytes];
+
+		for (int x = 0; x < width; x++) {
+			int v = pnm_getc(r);
+			if ((v >= 0) && (maxval > 255)) {
+				int lo = pnm_getc(r);
+				v = lo < 0 ? lo : (v << 8) | lo;
+			}
+			if (v < 0) {
+				return PNM_ERR_SHORT;
+			}
+
+			// White if brighter than the threshold at (x, y), so that
+			// 0 is always black and maxval always white
+			if (v * 128 > (2 * bayer[y & 0x7][x & 0x7] + 1) * maxval) {
+				row[x / 8] |= 0x80 >> (x & 0x7);
+			}
+		}
+	}
+
+	return 0;
+}
+
+int pnm_load(lfs_t *lfs, struct page_arena *arena, const char *path,
+		int *width, int *height, uint8_t **data)
+{
+	char hdr[PNM_HEADER_MAX];
+	struct pnm_reader r = { 0 };
+	int w, h, maxval = 1;
+	lfs_file_t fp;
+	uint8_t *out;
+	int res, pos;
+
+	res = lfs_file_open(lfs, &fp, path, LFS_O_RDONLY);
+	if (res) {
+		return PNM_ERR_IO;
+	}
+
+	int len = lfs_file_read(lfs, &fp, hdr, sizeof(hdr));
+	if (len < 2) {
+		res = len < 0 ? PNM_ERR_IO : PNM_ERR_FORMAT;
+		goto out_close;
+	}
+
+	if ((hdr[0] != 'P') || (hdr[1] < '1') || (hdr[1] > '6')) {
+		res = PNM_ERR_FORMAT;
+		goto out_close;
+	} else if ((hdr[1] != '4') && (hdr[1] != '5')) {
+		res = PNM_ERR_UNSUPPORTED;
+		goto out_close;
+	}
+
+	pos = 2;
+	res = pnm_header_uint(hdr, len, &pos, &w);
+	if (!res) {
+		res = pnm_header_uint(hdr, len, &pos, &h);
+	}
+	if (!res && (hdr[1] == '5')) {
+		res = pnm_header_uint(hdr, len, &pos, &maxval);
+	}
+	if (res) {
+		goto out_close;
+	}
+
+	if ((w == 0) || (h == 0) || (maxval == 0)) {
+		res = PNM_ERR_FORMAT;
+		goto out_close;
+	}
+
+	if (w % 8) {
+		res = PNM_ERR_WIDTH;
+		goto out_close;
+	}
+
+	// Exactly one whitespace character separates the header and the data
+	res = lfs_file_seek(lfs, &fp, pos + 1, LFS_SEEK_SET);
+	if (res < 0) {
+		res = PNM_ERR_IO;
+		goto out_close;
+	}
+
+	out = page_arena_alloc_top(arena, (w / 8) * h);
+	if (!out) {
+		res = PNM_ERR_NOMEM;
+		goto out_close;
+	}
+
+	r.lfs = lfs;
+	r.fp = &fp;
+	if (hdr[1] == '4') {
+		res = pnm_convert_pbm(&r, out, (w / 8) * h);
+	} else {
+		res = pnm_convert_pgm(&r, out, w, h, maxval);
+	}
+	if (res) {
+		goto out_close;
+	}
+
+	printf("converted %s: P%c %dx%d %d\n", path, hdr[1], w, h, maxval);
+
+	*width = w;
+	*height = h;
+	*data = out;
+
+out_close:
+	lfs_file_close(lfs, &fp);
+	return res;
+}
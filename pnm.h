@@ -0,0 +1,37 @@
+#ifndef __PNM_H__
+#define __PNM_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "littlefs/lfs.h"
+
+#include "page_arena.h"
+
+/*
+ * Images can be dropped onto the USB disk as binary PBM (P4) or PGM (P5)
+ * files, instead of having to be packed on a PC first. They're converted to
+ * the 1bpp format the renderer draws when pages are compiled during a sync,
+ * so greyscale is dithered once, on USB power.
+ */
+
+enum pnm_error {
+	PNM_ERR_IO = -1,
+	PNM_ERR_FORMAT = -2,
+	PNM_ERR_UNSUPPORTED = -3,
+	PNM_ERR_WIDTH = -4,
+	PNM_ERR_NOMEM = -5,
+	PNM_ERR_SHORT = -6,
+};
+
+// Whether 'path' should be loaded with pnm_load(), from its extension
+bool pnm_is_pnm(const char *path);
+
+// Load and convert 'path' into 1bpp data allocated from the top of 'arena'.
+// Returns 0 on success, or a pnm_error.
+int pnm_load(lfs_t *lfs, struct page_arena *arena, const char *path,
+		int *width, int *height, uint8_t **data);
+
+const char *pnm_strerror(int err);
+
+#endif /* __PNM_H__ */
@@ -0,0 +1,82 @@
+#include <stdio.h>
+
+#include "pico/multicore.h"
+#include "pico/util/queue.h"
+
+#include "badger.h"
+#include "render_worker.h"
+
+struct render_job {
+	render_worker_fn fn;
+	void *arg;
+	int x0, x1;
+};
+
+// The SIO FIFO belongs to multicore_lockout, so jobs go through queues
+static queue_t job_queue;
+static queue_t done_queue;
+static bool running;
+
+static void render_worker_main(void)
+{
+	bool res = true;
+
+	// Flash writes from core0 park this core in RAM
+	multicore_lockout_victim_init();
+	queue_add_blocking(&done_queue, &res);
+
+	for ( ;; ) {
+		struct render_job job;
+
+		queue_remove_blocking(&job_queue, &job);
+		res = job.fn(job.arg, job.x0, job.x1);
+		queue_add_blocking(&done_queue, &res);
+	}
+}
+
+void render_worker_start(void)
+{
+	if (running) {
+		return;
+	}
+
+	queue_init(&job_queue, sizeof(struct render_job), 1);
+	queue_init(&done_queue, sizeof(bool), 1);
+
+	multicore_launch_core1(render_worker_main);
+
+	// multicore_lockout_start_blocking() would wait forever if core1 hadn't
+	// set up its handler yet, so don't return until it has
+	bool started;
+	queue_remove_blocking(&done_queue, &started);
+
+	running = true;
+}
+
+bool render_worker_running(void)
+{
+	return running;
+}
+
+bool render_worker_split(render_worker_fn fn, void *arg)
+{
+	int mid = BADGER_WIDTH / 2;
+	bool res, res1;
+
+	if (!running) {
+		return fn(arg, 0, BADGER_WIDTH);
+	}
+
+	queue_add_blocking(&job_queue, &(struct render_job){
+		.fn = fn,
+		.arg = arg,
+		.x0 = mid,
+		.x1 = BADGER_WIDTH,
+	});
+
+	res = fn(arg, 0, mid);
+
+	queue_remove_blocking(&done_queue, &res1);
+
+	return res && res1;
+}
@@ -0,0 +1,27 @@
+#ifndef __RENDER_WORKER_H__
+#define __RENDER_WORKER_H__
+
+#include <stdbool.h>
+
+/*
+ * On battery core1 isn't needed for USB, so it can draw half of the page.
+ * The framebuffer is column-major, so each core drawing its own range of
+ * columns never touches the same bytes as the other.
+ *
+ * Once started, core1 belongs to the worker: it can't be used for USB.
+ * The worker is a multicore_lockout victim, so littlefs must be mounted
+ * with multicore set while it's running.
+ */
+
+// Draw columns 'x0' to 'x1' - 1, returns false on failure
+typedef bool (*render_worker_fn)(void *arg, int x0, int x1);
+
+void render_worker_start(void);
+bool render_worker_running(void);
+
+// Call 'fn' for the left half of the screen on this core and the right half
+// on core1, and wait for both. Returns false if either call failed.
+// Must only be called from core0.
+bool render_worker_split(render_worker_fn fn, void *arg);
+
+#endif /* __RENDER_WORKER_H__ */
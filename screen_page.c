@@ -1,8 +1,38 @@
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "screen_page.h"
 
 #include "badger.h"
+#include "packbits.h"
+#include "page_arena.h"
+#include "render_worker.h"
+#include "status.h"
+#include "text_metrics.h"
+
+// The layout context is allocated from the page's arena, if it has one
+static struct page_arena *lay_arena;
+
+static void *lay_realloc(void *block, size_t size)
+{
+	if (lay_arena) {
+		return page_arena_realloc(lay_arena, block, size);
+	}
+
+	return realloc(block, size);
+}
+
+static void lay_free(void *block)
+{
+	if (lay_arena) {
+		page_arena_free(lay_arena, block);
+	} else {
+		free(block);
+	}
+}
+
+#define LAY_REALLOC(_block, _size) lay_realloc(_block, _size)
+#define LAY_FREE(_block) lay_free(_block)
 
 // Note: MUST BE LAST!
 #define LAY_IMPLEMENTATION
@@ -23,10 +53,45 @@ static lay_vec4 page_item_get_margins(struct screen_page_item *item)
 	}
 }
 
-static void page_item_image_draw(struct screen_page_item *item, lay_vec4 rect)
+// Decode a few rows at a time and draw them, so the image is never decoded
+// in full
+static void page_item_image_draw_packed(struct screen_page_item *item, lay_vec4 rect, int x0, int x1)
 {
-	badger_pen(15);
-	badger_image(item->image.data, item->width, item->height, rect[0], rect[1]);
+	uint8_t strip[8 * (BADGER_WIDTH / 8)];
+	struct packbits_reader reader;
+	int row_bytes = item->image.width / 8;
+	int strip_rows = row_bytes ? sizeof(strip) / row_bytes : 0;
+
+	if (strip_rows > 8) {
+		strip_rows = 8;
+	} else if (strip_rows == 0) {
+		printf("image too wide to unpack: %d\n", item->image.width);
+		return;
+	}
+
+	packbits_reader_init(&reader, item->image.data, item->image.packed_size);
+
+	for (int y = 0; y < item->image.height; y += strip_rows) {
+		int rows = item->image.height - y < strip_rows ? item->image.height - y : strip_rows;
+
+		if (packbits_read(&reader, strip, rows * row_bytes)) {
+			printf("truncated image data\n");
+			return;
+		}
+
+		badger_image_cols(strip, item->image.width, rows, rect[0], rect[1] + y, x0, x1);
+	}
+}
+
+// Doesn't use the drawing state, so is safe on either core
+static void page_item_image_draw(struct screen_page_item *item, lay_vec4 rect, int x0, int x1)
+{
+	if (item->image.packed_size) {
+		page_item_image_draw_packed(item, rect, x0, x1);
+		return;
+	}
+
+	badger_image_cols(item->image.data, item->width, item->height, rect[0], rect[1], x0, x1);
 }
 
 static void page_item_text_draw(struct screen_page_item *item, lay_vec4 rect)
@@ -42,14 +107,21 @@ static void page_item_text_draw(struct screen_page_item *item, lay_vec4 rect)
 
 	badger_pen(item->text.color);
 	badger_thickness(item->text.thickness);
-	badger_text(item->text.text, rect[0] + item->text.thickness / 2, rect[1] + (item->height / 2), item->text.size, 0.0f, 1);
+	badger_text(item->text.text, rect[0] + item->text.thickness / 2, rect[1] + item->text.baseline, item->text.size, 0, 1);
+}
+
+// Only from the glyph cache, returns false if any glyph wasn't there
+static bool page_item_text_draw_cols(struct screen_page_item *item, lay_vec4 rect, int x0, int x1)
+{
+	return badger_text_cols(item->text.text, rect[0] + item->text.thickness / 2, rect[1] + item->text.baseline,
+			item->text.size, item->text.color, item->text.thickness, 1, x0, x1);
 }
 
 static void page_item_draw(struct screen_page_item *item, lay_vec4 rect)
 {
 	switch (item->type) {
 	case PAGE_ITEM_TYPE_IMAGE:
-		page_item_image_draw(item, rect);
+		page_item_image_draw(item, rect, 0, BADGER_WIDTH);
 		break;
 	case PAGE_ITEM_TYPE_TEXT:
 		page_item_text_draw(item, rect);
@@ -67,8 +139,11 @@ static void page_item_image_calculate_size(struct screen_page_item *item)
 
 static void page_item_text_calculate_size(struct screen_page_item *item)
 {
-	item->width = badger_measure_text(item->text.text, item->text.size, 1) + item->text.thickness;
-	item->height = (item->text.size * HERSHEY_HEIGHT) + item->text.thickness;
+	const struct text_metrics *metrics = badger_text_metrics(item->text.size);
+
+	item->width = text_metrics_measure(metrics, item->text.text, 1) + item->text.thickness;
+	item->height = text_metrics_height(metrics, item->text.thickness);
+	item->text.baseline = text_metrics_baseline(metrics, item->text.thickness);
 }
 
 void page_item_calculate_size(struct screen_page_item *item)
@@ -93,10 +168,11 @@ void screen_page_calculate_sizes(struct screen_page *page)
 }
 
 // Use https://github.com/randrew/layout
-void screen_page_display(struct screen_page *page)
+void screen_page_layout(struct screen_page *page)
 {
 	lay_context ctx;
 
+	lay_arena = page->arena;
 	lay_init_context(&ctx);
 
 	// Root item plus up-to two columns
@@ -161,16 +237,95 @@ void screen_page_display(struct screen_page *page)
 
 	lay_run_context(&ctx);
 
+	for (int i = 0; i < page->n_items; i++) {
+		struct screen_page_item *item = &items[i];
+		item->rect = lay_get_rect(&ctx, item->lay_id);
+	}
+
+	lay_destroy_context(&ctx);
+	lay_arena = NULL;
+
+	page->laid_out = true;
+}
+
+// Draw columns 'x0' to 'x1' - 1 of the page, called on both cores at once
+static bool screen_page_draw_cols(void *arg, int x0, int x1)
+{
+	struct screen_page *page = arg;
+	bool res = true;
+
+	for (int i = 0; i < page->n_items; i++) {
+		struct screen_page_item *item = &page->items[i];
+
+		switch (item->type) {
+		case PAGE_ITEM_TYPE_IMAGE:
+			page_item_image_draw(item, item->rect, x0, x1);
+			break;
+		case PAGE_ITEM_TYPE_TEXT:
+			if (!page_item_text_draw_cols(item, item->rect, x0, x1)) {
+				res = false;
+			}
+			break;
+		}
+	}
+
+	return res;
+}
+
+void screen_page_display(struct screen_page *page)
+{
+	bool drawn = false;
+
+	if (!page->laid_out) {
+		screen_page_layout(page);
+	}
+
 	badger_pen(15);
 	badger_clear();
 
 	for (int i = 0; i < page->n_items; i++) {
-		struct screen_page_item *item = &items[i];
-		lay_vec4 rect = lay_get_rect(&ctx, item->lay_id);
+		lay_vec4 rect = page->items[i].rect;
 
 		printf("%d: { %d, %d, %d, %d }\n", i, rect[0], rect[1], rect[2], rect[3]);
-		page_item_draw(item, rect);
 	}
 
-	badger_update(true);
+	// Only this core can stroke glyphs, so get them all into the cache
+	// first. If they don't all fit, just draw everything here instead.
+	if (render_worker_running()) {
+		screen_page_cache_glyphs(page);
+
+		drawn = render_worker_split(screen_page_draw_cols, page);
+		if (!drawn) {
+			printf("glyphs not cached, drawing on one core\n");
+			badger_pen(15);
+			badger_clear();
+		}
+	}
+
+	if (!drawn) {
+		for (int i = 0; i < page->n_items; i++) {
+			struct screen_page_item *item = &page->items[i];
+
+			page_item_draw(item, item->rect);
+		}
+	}
+
+	// Go out with the page, rather than in an update of their own
+	status_overlay();
+
+	badger_present_changed();
+}
+
+void screen_page_cache_glyphs(struct screen_page *page)
+{
+	for (int i = 0; i < page->n_items; i++) {
+		struct screen_page_item *item = &page->items[i];
+
+		if (item->type != PAGE_ITEM_TYPE_TEXT) {
+			continue;
+		}
+
+		badger_thickness(item->text.thickness);
+		badger_cache_text(item->text.text, item->text.size);
+	}
 }
@@ -1,10 +1,13 @@
 #ifndef __SCREEN_PAGE_H__
 #define __SCREEN_PAGE_H__
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "layout.h"
 
+struct page_arena;
+
 enum page_item_type {
 	PAGE_ITEM_TYPE_IMAGE = 1,
 	PAGE_ITEM_TYPE_TEXT,
@@ -17,31 +20,48 @@ struct screen_page_item {
 
 	// Updated during layout
 	lay_id lay_id;
+	lay_vec4 rect;
 
 	enum page_item_type type;
 	union {
 		// img WIDTH HEIGHT path.img
 		struct {
 			int width, height;
-			uint8_t *data;
+			const uint8_t *data;
+			// PackBits encoded size of 'data', 0 if it isn't encoded
+			uint32_t packed_size;
 		} image;
 		// text[.font] SIZE COLOR THICKNESS Text to display
 		struct {
-			float size;
+			// Fixed point, see BADGER_FIXED_ONE
+			int32_t size;
 			uint8_t color;
 			uint8_t thickness;
+			// From the top of the item to the glyph origin
+			int16_t baseline;
 			char *text;
 		} text;
 	};
 };
 
 struct screen_page {
+	// Everything belonging to the page is allocated from here
+	struct page_arena *arena;
+	// Item rects are valid
+	bool laid_out;
+	// Hash of the page source, for caching
+	uint32_t hash;
 	int n_items;
 	struct screen_page_item *items;
 };
 
 void screen_page_calculate_sizes(struct screen_page *page);
+void screen_page_layout(struct screen_page *page);
+// Draws and presents the page. The panel will still be refreshing when this
+// returns, see badger_fence().
 void screen_page_display(struct screen_page *page);
 void page_item_calculate_size(struct screen_page_item *item);
+// Stroke all of the page's text into the glyph cache, without drawing it
+void screen_page_cache_glyphs(struct screen_page *page);
 
 #endif /* __SCREEN_PAGE_H__ */
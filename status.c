@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "badger.h"
+#include "status.h"
+
+#define STATUS_MAX_LINES 4
+#define STATUS_MAX_LEN   64
+
+struct status_line {
+	int y;
+	char msg[STATUS_MAX_LEN];
+};
+
+// In the order they were set, as bands can overlap
+static struct status_line lines[STATUS_MAX_LINES];
+static int n_lines;
+
+void status_set(int y, const char *msg)
+{
+	int i;
+
+	for (i = 0; i < n_lines; i++) {
+		if (lines[i].y == y) {
+			break;
+		}
+	}
+
+	if (i < n_lines) {
+		// Keep the drawing order
+		memmove(&lines[i], &lines[i + 1], (n_lines - i - 1) * sizeof(lines[0]));
+		n_lines--;
+	} else if (n_lines == STATUS_MAX_LINES) {
+		// Drop the oldest
+		memmove(&lines[0], &lines[1], (n_lines - 1) * sizeof(lines[0]));
+		n_lines--;
+	}
+
+	printf("status %d: %s\n", y, msg);
+
+	lines[n_lines].y = y;
+	snprintf(lines[n_lines].msg, sizeof(lines[n_lines].msg), "%s", msg);
+	n_lines++;
+}
+
+bool status_pending(void)
+{
+	return n_lines > 0;
+}
+
+// Draw the pending messages and forget them, and mark them dirty if they're
+// to be presented on their own
+static void status_draw(bool dirty)
+{
+	for (int i = 0; i < n_lines; i++) {
+		struct status_line *line = &lines[i];
+
+		badger_pen(15);
+		badger_rectangle(0, line->y, BADGER_WIDTH, STATUS_BAND_HEIGHT);
+		badger_pen(0);
+		badger_thickness(1);
+		badger_text(line->msg, 10, line->y + STATUS_BAND_HEIGHT / 2, BADGER_FIXED(0.4f), 0, 1);
+
+		if (dirty) {
+			badger_dirty(0, line->y, BADGER_WIDTH, STATUS_BAND_HEIGHT);
+		}
+	}
+
+	n_lines = 0;
+}
+
+void status_flush(void)
+{
+	if (!n_lines) {
+		return;
+	}
+
+	// The bands usually touch, so this is one partial update
+	status_draw(true);
+	badger_present_dirty();
+}
+
+void status_overlay(void)
+{
+	status_draw(false);
+}
@@ -0,0 +1,27 @@
+#ifndef __STATUS_H__
+#define __STATUS_H__
+
+#include <stdbool.h>
+
+/*
+ * Status messages are shown in 16-pixel bands over whatever is on the
+ * screen. They often come in bursts (USB disconnected, then flash updated),
+ * so they're only recorded here, and drawn later all at once: either as a
+ * single partial update, or along with a page that's about to be displayed
+ * anyway.
+ */
+#define STATUS_BAND_HEIGHT 16
+
+// Record 'msg' for the band starting at 'y', replacing any message there
+void status_set(int y, const char *msg);
+
+// Whether there are messages which haven't been shown
+bool status_pending(void);
+
+// Draw and present pending messages, as one partial update
+void status_flush(void);
+
+// Draw pending messages over a page which is about to be presented
+void status_overlay(void);
+
+#endif /* __STATUS_H__ */
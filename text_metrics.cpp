@@ -0,0 +1,88 @@
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+
+#include "badger.h"
+#include "glyph_cache.h"
+#include "text_metrics.h"
+
+static struct text_metrics slots[TEXT_METRICS_SLOTS];
+static int n_slots;
+// Oldest slot, replaced next when they're all used
+static int next_slot;
+
+int32_t text_metrics_measure(const struct text_metrics *m, const char *message, uint8_t letter_spacing)
+{
+	int32_t width = 0;
+
+	for (const unsigned char *c = (const unsigned char *)message; *c; c++) {
+		unsigned int idx = *c - TEXT_METRICS_FIRST_CHAR;
+
+		if (idx < TEXT_METRICS_N_CHARS) {
+			width += m->advance[idx];
+		}
+		width += letter_spacing;
+	}
+
+	return width;
+}
+
+int32_t text_metrics_height(const struct text_metrics *m, uint8_t thickness)
+{
+	return m->ascent + m->descent + thickness;
+}
+
+int32_t text_metrics_baseline(const struct text_metrics *m, uint8_t thickness)
+{
+	// Lines are stamped with a thickness x thickness square, centred on
+	// the line, the same as Badger2040::pixel()
+	return m->ascent + thickness / 2;
+}
+
+static void text_metrics_fill(struct text_metrics *m, const hershey::font_t *font, uint32_t font_id, int32_t s)
+{
+	int32_t min_y = GLYPH_ORIGIN, max_y = GLYPH_ORIGIN;
+	float fs = badger_fixed_to_float(s);
+
+	m->font = font_id;
+	m->size = s;
+
+	for (int i = 0; i < TEXT_METRICS_N_CHARS; i++) {
+		unsigned char c = TEXT_METRICS_FIRST_CHAR + i;
+
+		m->advance[i] = hershey::measure_glyph(font, c, fs);
+
+		// Stroke to the same pixels as drawing would, but only keep the extent
+		hershey::glyph(font, [&](int32_t x1, int32_t y1, int32_t x2, int32_t y2) {
+			min_y = std::min(min_y, std::min(y1, y2));
+			max_y = std::max(max_y, std::max(y1, y2));
+		}, c, GLYPH_ORIGIN, GLYPH_ORIGIN, fs, 0.0f);
+	}
+
+	m->ascent = GLYPH_ORIGIN - min_y;
+	m->descent = max_y - GLYPH_ORIGIN;
+
+	printf("text metrics %08x %08x: ascent %d descent %d\n", (unsigned int)font_id, (unsigned int)s,
+			m->ascent, m->descent);
+}
+
+const struct text_metrics *text_metrics_get(const hershey::font_t *font, uint32_t font_id, int32_t s)
+{
+	for (int i = 0; i < n_slots; i++) {
+		if ((slots[i].font == font_id) && (slots[i].size == s)) {
+			return &slots[i];
+		}
+	}
+
+	struct text_metrics *m;
+	if (n_slots < TEXT_METRICS_SLOTS) {
+		m = &slots[n_slots++];
+	} else {
+		m = &slots[next_slot];
+		next_slot = (next_slot + 1) % TEXT_METRICS_SLOTS;
+	}
+
+	text_metrics_fill(m, font, font_id, s);
+
+	return m;
+}
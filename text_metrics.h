@@ -0,0 +1,51 @@
+#ifndef __TEXT_METRICS_H__
+#define __TEXT_METRICS_H__
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#include <stdint.h>
+
+/*
+ * Measuring text with the Hershey library walks each glyph and does float
+ * maths per character, and there's no way to ask it how tall a font is.
+ * Instead, the advance of every character and the extent of the whole font
+ * are worked out once for each font and size, then measuring is a table sum.
+ */
+#define TEXT_METRICS_FIRST_CHAR 32
+#define TEXT_METRICS_N_CHARS    96
+// Pages tend to use only a few sizes
+#define TEXT_METRICS_SLOTS      8
+
+struct text_metrics {
+	// Same as the glyph cache key
+	uint32_t font;
+	// Fixed point
+	int32_t size;
+	// Pixels above and below the glyph origin for the tallest glyphs,
+	// for a thickness of 1
+	int16_t ascent, descent;
+	// Characters outside the table have no glyph, and no advance
+	int16_t advance[TEXT_METRICS_N_CHARS];
+};
+
+// The same as hershey::measure_text()
+int32_t text_metrics_measure(const struct text_metrics *m, const char *message, uint8_t letter_spacing);
+
+// Height of text drawn with 'thickness'
+int32_t text_metrics_height(const struct text_metrics *m, uint8_t thickness);
+
+// Offset from the top of text drawn with 'thickness' to the glyph origin
+int32_t text_metrics_baseline(const struct text_metrics *m, uint8_t thickness);
+
+#ifdef __cplusplus
+ }
+
+#include "libraries/hershey_fonts/hershey_fonts.hpp"
+
+// Get the metrics for 'font' at size 's', working them out if needed
+const struct text_metrics *text_metrics_get(const hershey::font_t *font, uint32_t font_id, int32_t s);
+#endif
+
+#endif /* __TEXT_METRICS_H__ */
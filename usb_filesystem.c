@@ -5,11 +5,16 @@
 #include "fat_ramdisk.h"
 #include "fatfs/ff.h"
 #include "littlefs/lfs.h"
+#include "page_file.h"
 #include "usb.h"
 
 #define FATFS_SECTOR_SIZE 512
 #define FATFS_NUM_SECTORS 128
 
+// Written onto the USB disk after an update, saying what was wrong with any
+// pages which didn't compile. Never copied back to flash.
+#define PAGE_LOG_NAME "pages.log"
+
 // Don't initialise because this is only used when USB connected
 static uint8_t __attribute__ ((section ("noinit"))) fatfs_ramdisk_data[FATFS_SECTOR_SIZE * FATFS_NUM_SECTORS];
 static const struct fat_ramdisk fat_ramdisk = {
@@ -214,6 +219,8 @@ static int copy_fat_to_flash(lfs_t *lfs)
 			break;
 		} else if (dirent.fattrib & AM_DIR) {
 			continue;
+		} else if (strcmp(dirent.fname, PAGE_LOG_NAME) == 0) {
+			continue;
 		}
 
 		res = f_open(&fp, dirent.fname, FA_READ | FA_OPEN_EXISTING);
@@ -293,9 +300,39 @@ static int copy_fat_to_flash(lfs_t *lfs)
 	return 0;
 }
 
+struct page_log {
+	FIL fp;
+	bool open;
+	int n_failed;
+};
+
+static void page_log_report(void *user, const char *name, int res, const struct page_diag *diag)
+{
+	struct page_log *log = user;
+	char buf[LFS_NAME_MAX + sizeof(diag->msg) + 16];
+	int nwrote;
+
+	if (res == 0) {
+		snprintf(buf, sizeof(buf), "%s: ok\n", name);
+	} else if (diag->line) {
+		snprintf(buf, sizeof(buf), "%s:%d: %s\n", name, diag->line, diag->msg);
+		log->n_failed++;
+	} else {
+		snprintf(buf, sizeof(buf), "%s: %s\n", name, diag->msg);
+		log->n_failed++;
+	}
+
+	printf("%s", buf);
+
+	if (log->open) {
+		f_write(&log->fp, buf, strlen(buf), &nwrote);
+	}
+}
+
 int do_flash_update(lfs_t *lfs)
 {
 	FATFS fat = { 0 };
+	struct page_log log = { 0 };
 
 	int res = f_mount(&fat, "", 1);
 	if (res) {
@@ -309,6 +346,19 @@ int do_flash_update(lfs_t *lfs)
 		goto err_unmount;
 	}
 
+	// Not being able to write the log shouldn't stop the update
+	log.open = (f_open(&log.fp, PAGE_LOG_NAME, FA_WRITE | FA_CREATE_ALWAYS) == 0);
+
+	res = page_compile_all(lfs, page_log_report, &log);
+	if (log.open) {
+		f_close(&log.fp);
+	}
+	if (res) {
+		printf("failed to compile pages: %d", res);
+		goto err_unmount;
+	}
+	printf("%d pages failed to compile, see %s\n", log.n_failed, PAGE_LOG_NAME);
+
 	res = f_unmount("");
 	if (res) {
 		printf("failed to unmount fat: %d", res);